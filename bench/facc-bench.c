@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "facc.h"
+#include "gen.h"
+#include "pool.h"
+
+// End-to-end benchmark: solve a fixed matrix of generated instances and print per-phase timings and peak RSS as JSON.
+//
+// Every instance is written to a temporary text file once, then each run forks a child that reads and solves it the
+// way facc does, so the peak RSS reported for a run is that run's alone.
+
+typedef struct {
+    const char* name;
+    size_t n_facilities;
+    size_t n_clients;
+    size_t per_client; // facilities listed per client, 0 = dense
+} BenchCase;
+
+static const BenchCase cases[] = {
+    {"square", 2000, 2000, 0},         // as many facilities as clients
+    {"tall", 100, 50000, 0},           // few facilities, many clients
+    {"wide", 10000, 500, 0},           // many facilities, few clients
+    {"sparse-like", 10000, 50000, 16}, // each client only reaches a handful of facilities
+};
+
+// What a child reports back through its pipe
+typedef struct {
+    bool ok;
+    double parse;
+    FlpTimings timings;
+    double wall;
+    double cost;
+} RunResult;
+
+// Write the case's instance in the text format, uniform costs throughout
+static bool write_instance(const BenchCase* c, size_t scale, const char* path) {
+    GenSpec spec      = gen_default_spec();
+    spec.n_facilities = c->n_facilities / scale;
+    spec.n_clients    = c->n_clients / scale;
+    spec.per_client   = c->per_client;
+
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Error: Cannot open file %s\n", path);
+        return false;
+    }
+    bool ok = gen_write_text(&spec, f);
+    ok      = fclose(f) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write %s\n", path);
+    }
+    return ok;
+}
+
+static RunResult solve(const char* path, const FlpOptions* options) {
+    RunResult result = {0};
+    double start     = monotonic_seconds();
+    Data data        = {0};
+    init_data(&data);
+    if (!read_problem_data((char*) path, &data)) {
+        return result;
+    }
+    result.parse = monotonic_seconds() - start;
+
+    FlpOptions run     = *options;
+    run.timings        = &result.timings;
+    Assignment* solved = NULL;
+    result.cost        = flp_with_options(&data, &run, &solved);
+    free_assignments(&data, solved);
+    free_data(&data);
+    result.wall = monotonic_seconds() - start;
+    result.ok   = true;
+    return result;
+}
+
+// Solve in a forked child so ru_maxrss covers this run only
+static bool run_once(const char* path, const FlpOptions* options, RunResult* result, long* peak_rss_kb) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        RunResult r = solve(path, options);
+        _exit(write(fds[1], &r, sizeof(r)) == (ssize_t) sizeof(r) && r.ok ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t got = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+        got != (ssize_t) sizeof(*result)) {
+        fprintf(stderr, "Error: Benchmark run on %s failed\n", path);
+        return false;
+    }
+    *peak_rss_kb = usage.ru_maxrss;
+    return true;
+}
+
+static void print_usage(const char* program) {
+    printf("Usage: %s [options]\n", program);
+    printf("Options:\n");
+    printf("  --repeat N        runs per instance (default 3)\n");
+    printf("  --threads N       passed on to the solver (0 = all CPUs, default 1)\n");
+    printf("  --rank STRATEGY   lazy, sort or transposed, passed on to the solver (default lazy)\n");
+    printf("  --quick           shrink every instance 10x, for a smoke test\n");
+}
+
+int main(int argc, char** argv) {
+    FlpOptions options = flp_default_options();
+    size_t repeat      = 3;
+    size_t scale       = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            char* end;
+            long n = strtol(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || n < 1) {
+                printf("Invalid repeat count '%s'\n", argv[i]);
+                return 1;
+            }
+            repeat = (size_t) n;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            char* end;
+            long n = strtol(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || n < 0) {
+                printf("Invalid thread count '%s'\n", argv[i]);
+                return 1;
+            }
+            options.threads = n == 0 ? pool_default_threads() : (size_t) n;
+        } else if (strcmp(argv[i], "--rank") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "lazy") == 0) {
+                options.rank = RANK_LAZY;
+            } else if (strcmp(argv[i], "sort") == 0) {
+                options.rank = RANK_SORT;
+            } else if (strcmp(argv[i], "transposed") == 0) {
+                options.rank = RANK_TRANSPOSED;
+            } else {
+                printf("Unknown rank strategy '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            scale = 10;
+        } else {
+            print_usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    char path[] = "/tmp/facc-bench-XXXXXX";
+    int fd      = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    bool ok = true;
+    printf("{\n  \"threads\": %zu,\n  \"rank\": \"%s\",\n  \"cases\": [", options.threads,
+           options.rank == RANK_SORT ? "sort" : options.rank == RANK_TRANSPOSED ? "transposed" : "lazy");
+    size_t n_cases = sizeof(cases) / sizeof(cases[0]);
+    for (size_t c = 0; c < n_cases && ok; c++) {
+        const BenchCase* bc = &cases[c];
+        ok                  = write_instance(bc, scale, path);
+        printf("%s\n    {\"name\": \"%s\", \"facilities\": %zu, \"clients\": %zu, \"per_client\": %zu, \"runs\": [",
+               c > 0 ? "," : "", bc->name, bc->n_facilities / scale, bc->n_clients / scale, bc->per_client);
+        for (size_t r = 0; r < repeat && ok; r++) {
+            RunResult result;
+            long peak_rss_kb = 0;
+            ok               = run_once(path, &options, &result, &peak_rss_kb);
+            if (ok) {
+                printf("%s\n      {\"parse_s\": %.6f, \"rank_s\": %.6f, \"greedy_s\": %.6f, \"iterations\": %zu, "
+                       "\"total_cost_s\": %.6f, \"wall_s\": %.6f, \"peak_rss_kb\": %ld, \"cost\": %.0f}",
+                       r > 0 ? "," : "", result.parse, result.timings.rank, result.timings.greedy,
+                       result.timings.iterations, result.timings.total_cost, result.wall, peak_rss_kb, result.cost);
+            }
+        }
+        printf("\n    ]}");
+    }
+    printf("\n  ]\n}\n");
+
+    remove(path);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_MIN_BLOCK ((size_t) 64 * 1024)
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    size_t capacity;
+    size_t used;
+    size_t pad_; // keeps data ARENA_ALIGN-aligned
+    unsigned char data[];
+};
+
+_Static_assert(sizeof(ArenaBlock) % ARENA_ALIGN == 0, "ArenaBlock must preserve alignment");
+
+#ifdef FACC_ALLOC_STATS
+#include <stdatomic.h>
+
+// Prefix of every stb_ds allocation in stats builds, so free/realloc know how many bytes they give back
+typedef struct {
+    size_t size;
+    size_t pad_; // keeps the container ARENA_ALIGN-aligned
+} AllocHeader;
+
+_Static_assert(sizeof(AllocHeader) % ARENA_ALIGN == 0, "AllocHeader must preserve alignment");
+
+static atomic_size_t stat_allocations;
+static atomic_size_t stat_reallocations;
+static atomic_size_t stat_frees;
+static atomic_size_t stat_bytes;
+static atomic_size_t stat_live;
+static atomic_size_t stat_peak;
+
+// One hook call: old_size is 0 for a new allocation
+static void stats_record(bool resized, size_t old_size, size_t size) {
+    atomic_fetch_add_explicit(resized ? &stat_reallocations : &stat_allocations, 1, memory_order_relaxed);
+    if (size >= old_size) {
+        atomic_fetch_add_explicit(&stat_bytes, size - old_size, memory_order_relaxed);
+        size_t live = atomic_fetch_add_explicit(&stat_live, size - old_size, memory_order_relaxed);
+        live += size - old_size;
+        size_t peak = atomic_load_explicit(&stat_peak, memory_order_relaxed);
+        while (live > peak && !atomic_compare_exchange_weak_explicit(&stat_peak, &peak, live, memory_order_relaxed,
+                                                                     memory_order_relaxed)) {
+        }
+    } else {
+        atomic_fetch_sub_explicit(&stat_live, old_size - size, memory_order_relaxed);
+    }
+}
+
+static void stats_record_free(size_t size) {
+    atomic_fetch_add_explicit(&stat_frees, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&stat_live, size, memory_order_relaxed);
+}
+
+bool alloc_stats_enabled(void) { return true; }
+
+void alloc_stats_read(AllocStats* stats) {
+    stats->allocations   = atomic_load_explicit(&stat_allocations, memory_order_relaxed);
+    stats->reallocations = atomic_load_explicit(&stat_reallocations, memory_order_relaxed);
+    stats->frees         = atomic_load_explicit(&stat_frees, memory_order_relaxed);
+    stats->bytes         = atomic_load_explicit(&stat_bytes, memory_order_relaxed);
+    stats->live_bytes    = atomic_load_explicit(&stat_live, memory_order_relaxed);
+    stats->peak_bytes    = atomic_load_explicit(&stat_peak, memory_order_relaxed);
+}
+
+void alloc_stats_reset_peak(void) {
+    atomic_store_explicit(&stat_peak, atomic_load_explicit(&stat_live, memory_order_relaxed), memory_order_relaxed);
+}
+
+void* stbds_hook_realloc(void* ptr, size_t size) {
+    AllocHeader* old = ptr ? (AllocHeader*) ptr - 1 : NULL;
+    size_t old_size  = old ? old->size : 0;
+    AllocHeader* h   = realloc(old, sizeof(AllocHeader) + size);
+    if (!h) {
+        return NULL;
+    }
+    h->size = size;
+    stats_record(old != NULL, old_size, size);
+    return h + 1;
+}
+
+void stbds_hook_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    AllocHeader* h = (AllocHeader*) ptr - 1;
+    stats_record_free(h->size);
+    free(h);
+}
+#else
+bool alloc_stats_enabled(void) { return false; }
+
+void alloc_stats_read(AllocStats* stats) { memset(stats, 0, sizeof(*stats)); }
+
+void alloc_stats_reset_peak(void) {}
+
+// Without stats the hooks are plain heap calls: stb_ds containers are long-lived solver state, and per-iteration
+// scratch comes from arena_alloc() directly
+void* stbds_hook_realloc(void* ptr, size_t size) { return realloc(ptr, size); }
+
+void stbds_hook_free(void* ptr) { free(ptr); }
+#endif
+
+static size_t align_up(size_t n) { return (n + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1); }
+
+static ArenaBlock* arena_add_block(Arena* arena, size_t min_size) {
+    size_t capacity = arena->capacity > ARENA_MIN_BLOCK ? arena->capacity : ARENA_MIN_BLOCK;
+    capacity        = capacity > min_size ? capacity : min_size;
+    ArenaBlock* b   = malloc(sizeof(ArenaBlock) + capacity);
+    assert(b && "Could not allocate arena block");
+    b->next       = arena->blocks;
+    b->capacity   = capacity;
+    b->used       = 0;
+    arena->blocks = b;
+    arena->capacity += capacity;
+    return b;
+}
+
+void arena_init(Arena* arena) {
+    arena->blocks   = NULL;
+    arena->capacity = 0;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size          = align_up(size);
+    ArenaBlock* b = arena->blocks;
+    if (!b || b->capacity - b->used < size) {
+        b = arena_add_block(arena, size);
+    }
+    void* p = b->data + b->used;
+    b->used += size;
+    return p;
+}
+
+void arena_reset(Arena* arena) {
+    if (arena->blocks && arena->blocks->next) {
+        // Several blocks were needed: replace them by one that fits the whole round next time
+        size_t capacity = arena->capacity;
+        arena_free(arena);
+        arena_add_block(arena, capacity);
+    }
+    if (arena->blocks) {
+        arena->blocks->used = 0;
+    }
+}
+
+void arena_free(Arena* arena) {
+    ArenaBlock* b = arena->blocks;
+    while (b) {
+        ArenaBlock* next = b->next;
+        free(b);
+        b = next;
+    }
+    arena_init(arena);
+}
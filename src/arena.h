@@ -0,0 +1,47 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bump allocator for solver scratch memory, plus the allocation hooks every stb_ds container goes through. The hooks
+// always use the heap (with a size prefix only in ALLOC_STATS builds); scratch buffers come from arena_alloc directly
+// and are released at once by arena_reset.
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock* blocks; // newest first
+    size_t capacity;    // sum of block capacities
+} Arena;
+
+void arena_init(Arena* arena);
+void* arena_alloc(Arena* arena, size_t size);
+// Forget every allocation. Memory is kept (coalesced into one block) for the next round.
+void arena_reset(Arena* arena);
+void arena_free(Arena* arena);
+
+void* stbds_hook_realloc(void* ptr, size_t size);
+void stbds_hook_free(void* ptr);
+
+// Allocation accounting for the stb_ds hooks, compiled in with -DFACC_ALLOC_STATS (make ALLOC_STATS=1); otherwise
+// alloc_stats_enabled() is false and the counters stay zero. Counts cover every thread; arena_alloc is not
+// counted.
+typedef struct {
+    size_t allocations;   // new containers
+    size_t reallocations; // growth (or shrinking) of existing ones
+    size_t frees;         // of containers
+    size_t bytes;         // requested: new allocations plus growth
+    size_t live_bytes;    // bytes currently held by stb_ds containers
+    size_t peak_bytes;    // high-water mark of live_bytes since the last alloc_stats_reset_peak()
+} AllocStats;
+
+bool alloc_stats_enabled(void);
+void alloc_stats_read(AllocStats* stats);
+void alloc_stats_reset_peak(void);
+
+#define STBDS_REALLOC(context, ptr, size) stbds_hook_realloc(ptr, size)
+#define STBDS_FREE(context, ptr) stbds_hook_free(ptr)
+#include "stb_ds.h"
+
+#endif // ARENA_H
@@ -0,0 +1,47 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Dense bitsets over positions, 64 per word
+
+static inline size_t bitset_words(size_t n) { return (n + 63) / 64; }
+
+// n bits, all set to value (bits past n are always clear)
+static inline uint64_t* bitset_alloc(size_t n, bool value) {
+    size_t n_words = bitset_words(n);
+    uint64_t* bits = calloc(n_words > 0 ? n_words : 1, sizeof(uint64_t));
+    assert(bits && "Could not allocate bitset");
+    if (value) {
+        for (size_t w = 0; w < n / 64; w++) {
+            bits[w] = UINT64_MAX;
+        }
+        if (n % 64) {
+            bits[n / 64] = (UINT64_C(1) << (n % 64)) - 1;
+        }
+    }
+    return bits;
+}
+
+static inline bool bitset_get(const uint64_t* bits, size_t i) { return (bits[i / 64] >> (i % 64)) & 1; }
+
+static inline void bitset_set(uint64_t* bits, size_t i) { bits[i / 64] |= UINT64_C(1) << (i % 64); }
+
+static inline void bitset_clear(uint64_t* bits, size_t i) { bits[i / 64] &= ~(UINT64_C(1) << (i % 64)); }
+
+static inline size_t bitset_count(const uint64_t* bits, size_t n) {
+    size_t count = 0;
+    for (size_t w = 0; w < bitset_words(n); w++) {
+        count += (size_t) __builtin_popcountll(bits[w]);
+    }
+    return count;
+}
+
+// Visit the set bits of word w in increasing order: for (uint64_t m = bits[w]; m; m &= m - 1) bitset_lowest(w, m)
+static inline size_t bitset_lowest(size_t w, uint64_t word) { return w * 64 + (size_t) __builtin_ctzll(word); }
+
+#endif // BITSET_H
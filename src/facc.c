@@ -1,11 +1,29 @@
 #include <assert.h>
+#include <fcntl.h>
+#include <float.h>
+#include <limits.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "arena.h"
+#include "bitset.h"
+#include "facc.h"
+#include "perf.h"
+#include "pool.h"
+#include "probes.h"
+#include "rank.h"
 #define STB_DS_IMPLEMENTATION
 #include "stb_ds.h"
+#undef STB_DS_IMPLEMENTATION // other sources pulled into the same unit (tests) must only see the declarations
 
 
 
@@ -17,74 +35,61 @@
 
 //  based on: https://www.jsoftware.us/index.php?m=content&c=index&a=show&catid=88&id=1445
 
-#define BUFFER_SIZE 1024
+// Integer ratios are compared by cross-multiplying their 64-bit sums and counts, which needs 128-bit products
+#ifdef __SIZEOF_INT128__
+#define FACC_EXACT_RATIOS
+__extension__ typedef __int128 RatioProduct;
+#endif
 
+// Best candidate set per facility, stored as parallel arrays so the argmin can scan ratios and counts as vectors
 typedef struct {
-    int facility;
-    int client;
-} pair_t;
-
-typedef struct {
-    pair_t key;
-    double value;
-} ConnectionCost;
-
-typedef struct {
-    int key; // facility
-    double value;
-} OpeningCost;
-
-typedef struct {
-    int key;
-    bool value;
-} FacilityOpened;
-
-typedef struct {
-    int key;    // client
-    bool value; // true = unconnected, false = connected
-} UsedClients;
-
-typedef struct {
-    size_t count;
-    int facility;
-    int* clients; // dynamic array
-} Assignment;
-
-typedef struct {
-    int facility;
-    int client;
-    double cost;
-} FacilityClientPair;
-
-typedef struct {
-    int facility;
-    int threshold;
-    size_t count;
-    double cost_ratio;
-    int* clients; // dynamic array
+    ptrdiff_t* threshold;
+    size_t* count; // 0 = no candidate set
+    double* cost_ratio;
+    size_t** clients; // dynamic arrays of client positions
+    // Exact mode (integer costs): candidates are ranked by cost_sum / count without dividing, cost_ratio is unused
+    bool exact;
+    int64_t* cost_sum; // connection costs plus the opening cost while the facility is closed
 } CostEffectivenessMatrix;
 
-typedef struct {
-    size_t n_facilities;
-    int* facilities;
-    OpeningCost* opening_costs;
-    int* clients;
-    size_t n_clients;
-    ConnectionCost* connection_costs;
-} Data;
-
 void init_data(Data* data) {
     data->clients          = NULL;
     data->facilities       = NULL;
     data->connection_costs = NULL;
     data->opening_costs    = NULL;
+    data->row_offsets      = NULL;
+    data->cost_facilities  = NULL;
+    data->mapping.data     = NULL;
+    data->mapping.size     = 0;
+    data->cost_type        = COST_F64;
+    data->geo              = (GeoPoints){.metric = GEO_NONE, .facility_points = NULL, .client_points = NULL};
 }
 
 void free_data(Data* data) {
+    if (data->mapping.data) {
+        // Binary input: every array is a view into the mapping
+        unmap_file(&data->mapping);
+        init_data(data);
+        return;
+    }
     arrfree(data->facilities);
     arrfree(data->clients);
-    hmfree(data->connection_costs);
-    hmfree(data->opening_costs);
+    arrfree(data->opening_costs);
+    if (is_geo(data)) {
+        arrfree(data->geo.facility_points);
+        arrfree(data->geo.client_points);
+        data->geo.metric = GEO_NONE;
+        return;
+    }
+    if (is_sparse(data)) {
+        // Sparse rows are built up with arrpush
+        arrfree(data->row_offsets);
+        arrfree(data->cost_facilities);
+        arrfree(data->connection_costs);
+        return;
+    }
+    free(data->connection_costs);
+    data->connection_costs = NULL;
 }
 
 void free_assignments(Data* data, Assignment* assignments) {
@@ -94,23 +99,12 @@ void free_assignments(Data* data, Assignment* assignments) {
     arrfree(assignments);
 }
 
-// Compare function for qsort
-int compare_pairs(const void* a, const void* b) {
-    FacilityClientPair* pa = (FacilityClientPair*) a;
-    FacilityClientPair* pb = (FacilityClientPair*) b;
-    if (pa->cost < pb->cost)
-        return -1;
-    if (pa->cost > pb->cost)
-        return 1;
-    return 0;
-}
-
-#define print_cost_matrix(cost_matrix, n_clients, n_facilities)                                                        \
+#define print_cost_matrix(rm, data)                                                                                    \
     do {                                                                                                               \
-        for (size_t i = 0; i < n_clients; i++) {                                                                       \
-            for (size_t j = 0; j < n_facilities; j++) {                                                                \
-                FacilityClientPair p = cost_matrix[i][j];                                                              \
-                printf("c%d,%d = %.0f | ", p.client + 1, p.facility + 1, p.cost);                                      \
+        for (size_t i = 0; i < (data)->n_clients; i++) {                                                               \
+            FacilityClientPair p;                                                                                      \
+            for (size_t t = 0; rank_matrix_at(rm, data, i, t, &p); t++) {                                              \
+                printf("c%zu,%d = %.0f | ", i, (data)->facilities[p.facility], p.cost);                                \
             }                                                                                                          \
             printf("\n");                                                                                              \
         }                                                                                                              \
@@ -131,316 +125,1392 @@ int compare_pairs(const void* a, const void* b) {
         }                                                                                                              \
     } while (0)
 
-int read_ints_from_line(FILE* fp, int* buffer) {
-    int count = 0;
-    char line[BUFFER_SIZE];
+// Allocate a rows x cols matrix of size-byte elements, returning NULL instead of wrapping around when the
+// byte count overflows size_t
+void* alloc_matrix(size_t rows, size_t cols, size_t size) {
+    if (cols != 0 && rows > SIZE_MAX / cols) {
+        return NULL;
+    }
+    size_t count = rows * cols;
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    return malloc(count * size);
+}
 
-    if (fgets(line, sizeof(line), fp) == NULL) {
-        return -1;
+// Map a whole file read-only. Empty files map to {NULL, 0}.
+bool map_file(const char* filename, MappedFile* file) {
+    file->data = NULL;
+    file->size = 0;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Could not open file '%s'\n", filename);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error: Could not stat file '%s'\n", filename);
+        close(fd);
+        return false;
+    }
+    if (st.st_size > 0) {
+        void* map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "Error: Could not map file '%s'\n", filename);
+            close(fd);
+            return false;
+        }
+        madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+        file->data = map;
+        file->size = (size_t) st.st_size;
     }
+    close(fd);
+    return true;
+}
+
+void unmap_file(MappedFile* file) {
+    if (file->data) {
+        munmap((void*) file->data, file->size);
+    }
+    file->data = NULL;
+    file->size = 0;
+}
+
+// Cursor over the raw input text. Lines may be any length; nothing is copied out of the mapping.
+typedef struct {
+    const char* pos;
+    const char* end;
+    const char* overflow; // first integer that does not fit an int, NULL if none
+} Scanner;
+
+static inline bool is_blank(char ch) { return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\v' || ch == '\f'; }
 
-    int number;
-    char* line_ptr = line;
-    int chars_read;
+static inline bool is_digit(char ch) { return (unsigned char) (ch - '0') < 10; }
 
-    while (sscanf(line_ptr, "%d%n", &number, &chars_read) == 1) {
-        buffer[count] = number;
+static inline bool at_eof(const Scanner* sc) { return sc->pos >= sc->end; }
+
+// Parse the next integer on the current line. Returns false at the end of the line, or at anything that is
+// not an integer (the rest of that line is then ignored, as with the old sscanf loop). An integer outside the int
+// range saturates and is recorded in sc->overflow, so the caller can reject the input after the section is read.
+static inline bool scan_int(Scanner* sc, int* value) {
+    const char* p = sc->pos;
+    while (p < sc->end && is_blank(*p)) {
+        p++;
+    }
+    const char* start = p;
+    bool negative     = false;
+    if (p < sc->end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    if (p >= sc->end || !is_digit(*p)) {
+        return false;
+    }
+    int64_t limit = negative ? -(int64_t) INT_MIN : INT_MAX;
+    int64_t n     = 0;
+    for (; p < sc->end && is_digit(*p); p++) {
+        int64_t digit = *p - '0';
+        if (n > (limit - digit) / 10) {
+            sc->overflow = sc->overflow ? sc->overflow : start;
+            n            = limit;
+        } else {
+            n = n * 10 + digit;
+        }
+    }
+    *value  = (int) (negative ? -n : n);
+    sc->pos = p;
+    return true;
+}
+
+// Consume ch if it is the next character
+static inline bool scan_char(Scanner* sc, char ch) {
+    if (sc->pos < sc->end && *sc->pos == ch) {
+        sc->pos++;
+        return true;
+    }
+    return false;
+}
+
+// Parse the next real number (strtod syntax) on the current line
+static bool scan_real(Scanner* sc, double* value) {
+    const char* p = sc->pos;
+    while (p < sc->end && is_blank(*p)) {
+        p++;
+    }
+    const char* start = p;
+    while (p < sc->end && (is_digit(*p) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E')) {
+        p++;
+    }
+    char number[64]; // the mapping is not NUL-terminated, strtod gets a copy
+    size_t len = (size_t) (p - start);
+    if (len == 0 || len >= sizeof(number)) {
+        return false;
+    }
+    memcpy(number, start, len);
+    number[len] = '\0';
+    char* end;
+    *value = strtod(number, &end);
+    if (end != number + len) {
+        return false;
+    }
+    sc->pos = p;
+    return true;
+}
+
+// Consume word if it is the next token on the current line
+static bool scan_word(Scanner* sc, const char* word) {
+    const char* p = sc->pos;
+    while (p < sc->end && is_blank(*p)) {
+        p++;
+    }
+    size_t len = strlen(word);
+    if ((size_t) (sc->end - p) < len || memcmp(p, word, len) != 0 ||
+        (p + len < sc->end && !is_blank(p[len]) && p[len] != '\n')) {
+        return false;
+    }
+    sc->pos = p + len;
+    return true;
+}
+
+// Move past the end of the current line
+static inline void skip_line(Scanner* sc) {
+    const char* newline = memchr(sc->pos, '\n', (size_t) (sc->end - sc->pos));
+    sc->pos             = newline ? newline + 1 : sc->end;
+}
+
+// Append every integer on the current line to the stb_ds array *out. Returns the count, or -1 at end of input.
+static ptrdiff_t scan_int_line(Scanner* sc, int** out) {
+    if (at_eof(sc)) {
+        return -1;
+    }
+    ptrdiff_t count = 0;
+    int value;
+    while (scan_int(sc, &value)) {
+        arrpush(*out, value);
         count++;
-        line_ptr += chars_read;
     }
+    skip_line(sc);
     return count;
 }
 
-bool read_problem_data(char* filename, Data* data) {
+// Dense cost section: one row of n_facilities costs per client
+static void parse_dense_costs(Scanner* sc, Data* data) {
+    int value;
+    data->connection_costs = alloc_matrix(data->n_clients, data->n_facilities, sizeof(double));
+    assert((data->connection_costs || data->n_clients * data->n_facilities == 0) && "Could not allocate cost matrix");
+    size_t c = 0;
+    while (c < data->n_clients && !at_eof(sc)) {
+        double* row = &data->connection_costs[c * data->n_facilities];
+        size_t j    = 0;
+        while (scan_int(sc, &value)) {
+            assert(j < data->n_facilities && "Cost row length must match number of facilities");
+            row[j++] = (double) value;
+        }
+        assert(j == data->n_facilities && "Cost row length must match number of facilities");
+        skip_line(sc);
+        c++;
+    }
 
-    FILE* fp = fopen(filename, "r");
-    if (!fp) {
-        fprintf(stderr, "Error: Could not open file '%s'\n", filename);
-        return false;
+    assert(c == data->n_clients && "Not enough cost rows for the number of clients specified");
+}
+
+typedef struct {
+    int id;
+    uint32_t position;
+} FacilityKey;
+
+typedef struct {
+    uint32_t facility;
+    double cost;
+} SparseEntry;
+
+static int compare_facility_keys(const void* a, const void* b) {
+    int ia = ((const FacilityKey*) a)->id;
+    int ib = ((const FacilityKey*) b)->id;
+    return (ia > ib) - (ia < ib);
+}
+
+static int compare_sparse_entries(const void* a, const void* b) {
+    uint32_t fa = ((const SparseEntry*) a)->facility;
+    uint32_t fb = ((const SparseEntry*) b)->facility;
+    return (fa > fb) - (fa < fb);
+}
+
+// Binary search for a facility ID in the sorted key table
+static bool find_facility(const FacilityKey* keys, size_t n, int id, uint32_t* position) {
+    size_t lo = 0;
+    size_t hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (keys[mid].id < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < n && keys[lo].id == id) {
+        *position = keys[lo].position;
+        return true;
+    }
+    return false;
+}
+
+// Sparse cost section: per client, a line of facility:cost pairs (facility by ID), stored as CSR.
+// Each row is kept sorted by facility position so connection_cost() can binary search it.
+static void parse_sparse_costs(Scanner* sc, Data* data) {
+    assert(data->n_facilities <= UINT32_MAX && "Too many facilities for a sparse instance");
+    FacilityKey* keys = alloc_matrix(data->n_facilities, 1, sizeof(FacilityKey));
+    assert((keys || data->n_facilities == 0) && "Could not allocate facility table");
+    for (size_t i = 0; i < data->n_facilities; i++) {
+        keys[i].id       = data->facilities[i];
+        keys[i].position = (uint32_t) i;
+    }
+    qsort(keys, data->n_facilities, sizeof(FacilityKey), compare_facility_keys);
+
+    SparseEntry* row = NULL; // one client's entries, reused across rows
+    arrsetlen(data->row_offsets, data->n_clients + 1);
+    data->row_offsets[0] = 0;
+    size_t c             = 0;
+    int id;
+    while (c < data->n_clients && !at_eof(sc)) {
+        if (row) {
+            stbds_header(row)->length = 0; // arrsetlen(row, 0) trips -Wtype-limits in the macro
+        }
+        while (scan_int(sc, &id)) {
+            SparseEntry e;
+            int value;
+            bool has_colon = scan_char(sc, ':');
+            assert(has_colon && "Sparse cost entries must be written as facility:cost");
+            bool has_cost = scan_int(sc, &value);
+            assert(has_cost && "Sparse cost entries must be written as facility:cost");
+            bool known = find_facility(keys, data->n_facilities, id, &e.facility);
+            assert(known && "Sparse cost entry refers to an unknown facility");
+            (void) has_colon, (void) has_cost, (void) known;
+            e.cost = (double) value;
+            arrpush(row, e);
+        }
+        skip_line(sc);
+
+        size_t len = arrlenu(row);
+        qsort(row, len, sizeof(SparseEntry), compare_sparse_entries);
+        for (size_t k = 0; k < len; k++) {
+            assert((k == 0 || row[k - 1].facility != row[k].facility) && "Facility listed twice in a sparse row");
+            arrpush(data->cost_facilities, row[k].facility);
+            arrpush(data->connection_costs, row[k].cost);
+        }
+        c++;
+        data->row_offsets[c] = arrlenu(data->cost_facilities);
+    }
+
+    assert(c == data->n_clients && "Not enough cost rows for the number of clients specified");
+    arrfree(row);
+    free(keys);
+}
+
+// Point header: "geo euclidean|haversine [rate]", the rate (cost per unit of distance) defaulting to 1
+static void parse_geo_header(Scanner* sc, GeoPoints* geo) {
+    if (scan_word(sc, "euclidean")) {
+        geo->metric = GEO_EUCLIDEAN;
+        geo->dim    = 2;
+    } else if (scan_word(sc, "haversine")) {
+        geo->metric = GEO_HAVERSINE;
+        geo->dim    = 3;
+    } else {
+        assert(false && "Point metric must be euclidean or haversine");
+    }
+    if (!scan_real(sc, &geo->rate)) {
+        geo->rate = 1;
+    }
+    assert(geo->rate >= 0 && isfinite(geo->rate) && "Cost rate must be a non-negative number");
+    skip_line(sc);
+}
+
+// Point section: one line of two coordinates per position
+static void parse_points(Scanner* sc, const GeoPoints* geo, size_t n, double** points) {
+    for (size_t i = 0; i < n; i++) {
+        assert(!at_eof(sc) && "Not enough point lines");
+        double a, b;
+        bool ok = scan_real(sc, &a) && scan_real(sc, &b);
+        assert(ok && "Point lines must hold two coordinates");
+        (void) ok;
+        geo_push_point(geo, points, a, b);
+        skip_line(sc);
+    }
+}
+
+// A cost section is sparse when its first row is written as facility:cost pairs (or is empty: only sparse
+// rows may list no facilities)
+static bool cost_section_is_sparse(const Scanner* sc) {
+    Scanner peek = *sc;
+    int value;
+    if (!scan_int(&peek, &value)) {
+        return !at_eof(&peek);
+    }
+    return scan_char(&peek, ':');
+}
+
+// Parse the 4-section text format held in memory (see Readme.md)
+bool parse_problem_text(const char* text, size_t size, Data* data) {
+    Scanner sc = {.pos = text, .end = text + size};
+    int value;
+
+    // 0) Point instances start with a header line instead of carrying a cost section
+    if (scan_word(&sc, "geo")) {
+        parse_geo_header(&sc, &data->geo);
     }
-    int buffer[BUFFER_SIZE];
 
     // 1) Read Facilities
-    int n_f = read_ints_from_line(fp, buffer);
+    ptrdiff_t n_f = scan_int_line(&sc, &data->facilities);
     assert(n_f != -1 && "Could not read facilities");
     data->n_facilities = (size_t) n_f;
-    for (int i = 0; i < n_f; i++) {
-        arrpush(data->facilities, buffer[i]);
-    }
 
     // 2) Read Opening Costs
-    int count = read_ints_from_line(fp, buffer);
-    assert(count != -1 && "Could not read opening cost line");
-    assert(count == n_f && "First and second line must have same number of values");
-    for (int i = 0; i < count; i++) {
-        hmput(data->opening_costs, data->facilities[i], (double) buffer[i]);
+    assert(!at_eof(&sc) && "Could not read opening cost line");
+    ptrdiff_t count = 0;
+    while (scan_int(&sc, &value)) {
+        arrpush(data->opening_costs, (double) value);
+        count++;
     }
+    skip_line(&sc);
+    assert(count == n_f && "First and second line must have same number of values");
 
     // 3) Read Clients
-    int n_c = read_ints_from_line(fp, buffer);
+    ptrdiff_t n_c = scan_int_line(&sc, &data->clients);
     assert(n_c != -1 && "Could not read client ids");
     data->n_clients = (size_t) n_c;
-    for (int i = 0; i < n_c; i++) {
-        arrpush(data->clients, buffer[i]);
+
+    // 4) Read Cost Matrix, straight into the cost store, or the facility and then the client points
+    if (is_geo(data)) {
+        parse_points(&sc, &data->geo, data->n_facilities, &data->geo.facility_points);
+        parse_points(&sc, &data->geo, data->n_clients, &data->geo.client_points);
+    } else if (cost_section_is_sparse(&sc)) {
+        parse_sparse_costs(&sc, data);
+    } else {
+        parse_dense_costs(&sc, data);
     }
+    // Every cost in the text format is an int; point costs are computed, never stored
+    data->cost_type = is_geo(data) ? COST_F64 : COST_I32;
 
-    // 4) Read Cost Matrix
-    int c = 0;
-    int row_count;
-    while (c < n_c && (row_count = read_ints_from_line(fp, buffer)) != -1) {
-        assert(row_count == n_f && "Cost row length must match number of facilities");
-        for (int i = 0; i < row_count; i++) {
-            pair_t p = {.client = data->clients[c], .facility = data->facilities[i]};
-            hmput(data->connection_costs, p, (double) buffer[i]);
+    if (sc.overflow) {
+        size_t line = 1;
+        for (const char* p = text; p < sc.overflow; p++) {
+            line += *p == '\n';
         }
-        c++;
+        fprintf(stderr, "Error: Integer out of range on line %zu\n", line);
+        return false;
     }
-
-    assert(c == n_c && "Not enough cost rows for the number of clients specified");
-    fclose(fp);
     return true;
 }
 
-double connection_cost(Data* data, int client, int facility) {
-    pair_t p = {.client = client, .facility = facility};
-    return hmget(data->connection_costs, p);
+// Position of the first client that lists no facility at all (only sparse rows can be empty), SIZE_MAX if none
+size_t unreachable_client(const Data* data) {
+    for (size_t i = 0; i < data->n_clients; i++) {
+        if (data->n_facilities == 0 || (is_sparse(data) && row_begin(data, i + 1) == row_begin(data, i))) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
 }
 
-double opening_cost(Data* data, int facility) { return hmget(data->opening_costs, facility); }
-
-double flp(Data* data, Assignment** assignment) {
-    Assignment* tmp_assignment = NULL;
-    size_t n_facilities        = data->n_facilities;
-    size_t n_clients           = data->n_clients;
-
-    // Initialize assignments
-    for (size_t i = 0; i < n_facilities; i++) {
-        Assignment a = {.count = 0, .facility = data->facilities[i], .clients = NULL};
-        arrpush(tmp_assignment, a);
+// Load either input format: .faccb files are used in place, text is parsed into the cost store
+bool read_problem_data(char* filename, Data* data) {
+    FACC_PROBE1(parse__start, filename);
+    MappedFile file;
+    if (!map_file(filename, &file)) {
+        return false;
     }
-
-    int t          = 0;
-    UsedClients* U = NULL;
-
-    FacilityOpened* opened = NULL;
-
-    for (size_t i = 0; i < n_clients; i++) {
-        hmput(U, data->clients[i], true);
+    bool ok;
+    if (is_problem_binary(&file)) {
+        ok = load_problem_binary(&file, data);
+    } else {
+        ok = parse_problem_text(file.data, file.size, data);
+        unmap_file(&file);
+    }
+    size_t unreachable = ok ? unreachable_client(data) : SIZE_MAX;
+    if (unreachable != SIZE_MAX) {
+        fprintf(stderr, "Error: Client %d cannot reach any facility\n", data->clients[unreachable]);
+        ok = false;
+    }
+    if (ok) {
+        FACC_PROBE2(parse__end, data->n_facilities, data->n_clients);
     }
+    return ok;
+}
 
-    for (size_t i = 0; i < n_facilities; i++) {
-        hmput(opened, data->facilities[i], false);
+// Costs are addressed by dense position (index into data->clients / data->facilities), not by ID.
+// A facility a sparse client cannot reach costs INFINITY.
+double connection_cost(Data* data, size_t client, size_t facility) {
+    if (is_geo(data)) {
+        return geo_cost(&data->geo, client, facility);
+    }
+    if (!is_sparse(data)) {
+        return data->connection_costs[client * data->n_facilities + facility];
+    }
+    size_t lo = data->row_offsets[client];
+    size_t hi = data->row_offsets[client + 1];
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (data->cost_facilities[mid] < facility) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
+    if (lo < data->row_offsets[client + 1] && data->cost_facilities[lo] == facility) {
+        return data->connection_costs[lo];
+    }
+    return INFINITY;
+}
 
-    // Sort the connection cost of all facility-client pairs
-    FacilityClientPair cost_matrix[n_clients][n_facilities];
-    for (size_t i = 0; i < n_clients; i++) {
-        int client = data->clients[i];
-        for (size_t j = 0; j < n_facilities; j++) {
-            int facility               = data->facilities[j];
-            cost_matrix[i][j].facility = facility;
-            cost_matrix[i][j].client   = client;
-            cost_matrix[i][j].cost     = connection_cost(data, client, facility);
+// Whether every stored cost converts to cost_type and back unchanged. Point instances only rank in double. The type
+// the loader recorded has been checked already, so it costs no pass over the costs.
+bool cost_type_fits(const Data* data, CostType cost_type) {
+    if (cost_type == COST_AUTO || cost_type == COST_F64 || cost_type == data->cost_type) {
+        return true;
+    }
+    if (is_geo(data)) {
+        return false;
+    }
+    size_t n_costs = row_begin(data, data->n_clients);
+    for (size_t k = 0; k < n_costs; k++) {
+        double cost = data->connection_costs[k];
+        double back;
+        switch (cost_type) {
+        case COST_F32:
+            if (!(fabs(cost) <= FLT_MAX)) {
+                return false;
+            }
+            back = (double) (float) cost;
+            break;
+        case COST_I32:
+            if (!(cost >= INT32_MIN && cost <= INT32_MAX)) {
+                return false;
+            }
+            back = (double) (int32_t) cost;
+            break;
+        case COST_F64:
+        case COST_AUTO:
+        default:
+            back = cost;
+        }
+        if (back < cost || back > cost) {
+            return false;
         }
-        qsort(cost_matrix[i], n_facilities, sizeof(FacilityClientPair), compare_pairs);
     }
-    // print_cost_matrix(cost_matrix, n_clients, n_facilities);
+    return true;
+}
 
-    // Initialize cost effectiveness matrix
-    CostEffectivenessMatrix* ce = NULL;
-    for (size_t i = 0; i < n_facilities; i++) {
-        CostEffectivenessMatrix c = {
-            .facility = data->facilities[i], .threshold = -1, .count = 0, .cost_ratio = 0.0, .clients = NULL};
-        arrpush(ce, c);
+CostType narrowest_cost_type(const Data* data) {
+    if (cost_type_fits(data, COST_I32)) {
+        return COST_I32;
     }
+    return cost_type_fits(data, COST_F32) ? COST_F32 : COST_F64;
+}
 
-    size_t n_unassigned = n_clients;
-    while (n_unassigned > 0 && t < (int) n_facilities) {
-        // Create temporary arrays for this iteration
-        int** facility_clients  = NULL; // array of arrays
-        double** facility_costs = NULL; // array of arrays
-        size_t* facility_counts = NULL; // simple counts array
+double opening_cost(Data* data, size_t facility) { return data->opening_costs[facility]; }
 
-        // Initialize per-facility arrays
-        for (size_t i = 0; i < n_facilities; i++) {
-            int* clients  = NULL;
-            double* costs = NULL;
-            arrpush(facility_clients, clients);
-            arrpush(facility_costs, costs);
-            arrpush(facility_counts, 0);
+#define NO_PICK UINT32_MAX
+// Bitset words (64 clients) per parallel chunk of the pick phase, and facilities per chunk of the evaluation
+#define PICK_GRAIN 16
+#define EFFECTIVENESS_GRAIN 32
+#define PICK_PREFETCH 8
+
+typedef struct {
+    RankMatrix* rm;
+    const Data* data;
+    const uint64_t* U;
+    size_t t;
+    uint32_t* pick; // facility position at rank t, NO_PICK if the client has run out
+    double* pick_cost;
+    TraceExtent* extents; // per worker, when tracing
+} PickJob;
+
+// Walk over the set bits of U in words [w, end)
+typedef struct {
+    const uint64_t* U;
+    size_t w;
+    size_t end;
+    uint64_t word; // bits of word w not visited yet
+} ClientCursor;
+
+static inline bool next_client(ClientCursor* cursor, size_t* client) {
+    while (cursor->word == 0) {
+        if (++cursor->w >= cursor->end) {
+            return false;
         }
+        cursor->word = cursor->U[cursor->w];
+    }
+    *client = bitset_lowest(cursor->w, cursor->word);
+    cursor->word &= cursor->word - 1;
+    return true;
+}
 
-        // Get all the pairs at rank t
-        for (size_t i = 0; i < n_clients; i++) {
-            int client = data->clients[i];
+// Pick the rank-t pair of every unassigned client in bitset words [begin_word, end_word). Their entries are
+// prefetched PICK_PREFETCH clients ahead: once most clients are assigned, every one is a cache miss of its own.
+static void pick_clients(void* ctx, size_t begin_word, size_t end_word, size_t worker) {
+    PickJob* job = ctx;
+    double start = job->extents ? monotonic_seconds() : 0;
 
-            // If client is already assigned, skip it
-            if (!hmget(U, client)) {
-                continue;
+    ClientCursor ahead = {.U = job->U, .w = begin_word, .end = end_word, .word = job->U[begin_word]};
+    size_t next;
+    for (size_t k = 0; k < PICK_PREFETCH && next_client(&ahead, &next); k++) {
+        rank_matrix_prefetch(job->rm, job->data, next, job->t);
+    }
+    for (size_t w = begin_word; w < end_word; w++) {
+        for (uint64_t word = job->U[w]; word != 0; word &= word - 1) {
+            size_t client = bitset_lowest(w, word);
+            if (next_client(&ahead, &next)) {
+                rank_matrix_prefetch(job->rm, job->data, next, job->t);
             }
+            // A sparse client may have run out of reachable facilities
+            FacilityClientPair ranked;
+            bool has_rank          = rank_matrix_at(job->rm, job->data, client, job->t, &ranked);
+            job->pick[client]      = has_rank ? ranked.facility : NO_PICK;
+            job->pick_cost[client] = has_rank ? ranked.cost : 0.0;
+        }
+    }
+    if (job->extents) {
+        trace_extent_add(&job->extents[worker], start, monotonic_seconds());
+    }
+}
 
-            int facility = cost_matrix[i][t].facility;
-            double cost  = cost_matrix[i][t].cost;
+// Sign of a_sum / a_count - b_sum / b_count, exactly (counts > 0). Sums stay below 2^63 and counts below 2^31,
+// so the products fit.
+static inline int exact_ratio_order(int64_t a_sum, size_t a_count, int64_t b_sum, size_t b_count) {
+#ifdef FACC_EXACT_RATIOS
+    RatioProduct lhs = (RatioProduct) a_sum * (RatioProduct) b_count;
+    RatioProduct rhs = (RatioProduct) b_sum * (RatioProduct) a_count;
+    return (lhs > rhs) - (lhs < rhs);
+#else
+    (void) a_sum, (void) a_count, (void) b_sum, (void) b_count;
+    assert(false && "Exact ratios need 128-bit integers");
+    return 0;
+#endif
+}
 
-            // Find facility index
-            size_t fac_idx = 0;
-            for (size_t j = 0; j < n_facilities; j++) {
-                if (data->facilities[j] == facility) {
-                    fac_idx = j;
-                    break;
-                }
-            }
+// Sign of ratio a - ratio b; 0 for a tie (or a NaN, which never occurs: costs are finite or never picked)
+static inline int double_ratio_order(double a, double b) { return (a > b) - (a < b); }
+
+static inline int ce_ratio_order(const CostEffectivenessMatrix* ce, size_t a, size_t b) {
+    return ce->exact ? exact_ratio_order(ce->cost_sum[a], ce->count[a], ce->cost_sum[b], ce->count[b])
+                     : double_ratio_order(ce->cost_ratio[a], ce->cost_ratio[b]);
+}
 
-            arrpush(facility_clients[fac_idx], client);
-            arrpush(facility_costs[fac_idx], cost);
-            facility_counts[fac_idx]++;
+// Ratio of facility i's candidate set, for reporting
+static double ce_ratio(const CostEffectivenessMatrix* ce, size_t i) {
+    return ce->exact ? (double) ce->cost_sum[i] / (double) ce->count[i] : ce->cost_ratio[i];
+}
+
+// Strict order on candidate sets: lower ratio, then more clients, then lower position. SIZE_MAX (no candidate)
+// loses to everything.
+static bool ce_better(const CostEffectivenessMatrix* ce, size_t a, size_t b) {
+    if (a == SIZE_MAX || b == SIZE_MAX) {
+        return b == SIZE_MAX && a != SIZE_MAX;
+    }
+    int order = ce_ratio_order(ce, a, b);
+    if (order != 0) {
+        return order < 0;
+    }
+    return ce->count[a] != ce->count[b] ? ce->count[a] > ce->count[b] : a < b;
+}
+
+// Whether flp_with_options() can rank candidates exactly: integer connection costs (int32 in the rank matrix) and
+// opening costs, with every sum bounded well inside int64
+static bool exact_ratios_possible(const Data* data, CostType cost_type) {
+#ifdef FACC_EXACT_RATIOS
+    if (cost_type != COST_I32 || data->n_clients >= ((size_t) 1 << 31)) {
+        return false;
+    }
+    for (size_t i = 0; i < data->n_facilities; i++) {
+        double cost = data->opening_costs[i];
+        if (!(fabs(cost) <= 0x1p53) || cost < trunc(cost) || cost > trunc(cost)) {
+            return false;
         }
+    }
+    return true;
+#else
+    (void) data, (void) cost_type;
+    return false;
+#endif
+}
 
-        // Compute cost effectiveness for each facility
-        for (size_t i = 0; i < n_facilities; i++) {
-            int facility        = data->facilities[i];
-            size_t ce_n_clients = facility_counts[i];
+typedef struct {
+    Data* data;
+    const SimdKernels* kernels;
+    const uint64_t* opened;
+    CostEffectivenessMatrix* ce;
+    const size_t* facility_begin; // facility i's picks are [facility_begin[i], facility_begin[i + 1])
+    const size_t* clients;
+    const double* costs;
+    size_t t;
+    size_t* worker_best; // best facility in the ranges each worker handled, SIZE_MAX if none
+    TraceExtent* extents; // per worker, when tracing
+} EffectivenessJob;
+
+// Update ce for facilities [begin, end) from this iteration's picks, then fold their best into the worker's. The
+// order on candidates is strict, so the combined result does not depend on how ranges were split or stolen.
+static void evaluate_facilities(void* ctx, size_t begin, size_t end, size_t worker) {
+    EffectivenessJob* job       = ctx;
+    CostEffectivenessMatrix* ce = job->ce;
+    double start                = job->extents ? monotonic_seconds() : 0;
+
+    for (size_t i = begin; i < end; i++) {
+        size_t first        = job->facility_begin[i];
+        size_t ce_n_clients = job->facility_begin[i + 1] - first;
+
+        if (ce_n_clients == 0) {
+            continue;
+        }
 
-            if (ce_n_clients == 0) {
-                continue;
+        if (ce->exact) {
+            // Integer costs: (sum, count) pairs, compared by cross-multiplication instead of dividing
+            int64_t cost_sum = 0;
+            for (size_t k = 0; k < ce_n_clients; k++) {
+                cost_sum += (int64_t) job->costs[first + k];
             }
-
-            double cost_ratio = 0;
-            for (size_t j = 0; j < ce_n_clients; j++) {
-                cost_ratio += facility_costs[i][j];
+            if (!bitset_get(job->opened, i)) {
+                cost_sum += (int64_t) opening_cost(job->data, i);
             }
+            if (ce->count[i] > 0) {
+                int order = exact_ratio_order(cost_sum, ce_n_clients, ce->cost_sum[i], ce->count[i]);
+                if (order > 0 || (order == 0 && ce_n_clients < ce->count[i])) {
+                    continue;
+                }
+            }
+            ce->cost_sum[i] = cost_sum;
+        } else {
+            double cost_ratio = job->kernels->sum(job->costs + first, ce_n_clients);
 
             // Only add opening cost if facility hasn't been opened yet
-            if (!hmget(opened, facility)) {
-                cost_ratio += opening_cost(data, facility);
+            if (!bitset_get(job->opened, i)) {
+                cost_ratio += opening_cost(job->data, i);
             }
 
             cost_ratio = cost_ratio / (double) ce_n_clients;
 
-            if (ce[i].count > 0) {
-                if (cost_ratio > ce[i].cost_ratio || (cost_ratio == ce[i].cost_ratio && ce_n_clients < ce[i].count)) {
+            if (ce->count[i] > 0) {
+                int order = double_ratio_order(cost_ratio, ce->cost_ratio[i]);
+                if (order > 0 || (order == 0 && ce_n_clients < ce->count[i])) {
                     continue;
                 }
             }
+            ce->cost_ratio[i] = cost_ratio;
+        }
 
-            // Update cost effectiveness
-            ce[i].facility   = facility;
-            ce[i].threshold  = t;
-            ce[i].count      = ce_n_clients;
-            ce[i].cost_ratio = cost_ratio;
+        // Update cost effectiveness
+        ce->threshold[i] = (ptrdiff_t) job->t;
+        ce->count[i]     = ce_n_clients;
 
-            // Free old clients array and create new one
-            arrfree(ce[i].clients);
-            ce[i].clients = NULL;
-            for (size_t k = 0; k < ce_n_clients; k++) {
-                arrpush(ce[i].clients, facility_clients[i][k]);
+        // Replace the clients, reusing the array's capacity
+        arrsetlen(ce->clients[i], ce_n_clients);
+        memcpy(ce->clients[i], job->clients + first, ce_n_clients * sizeof(size_t));
+    }
+
+    if (ce->exact) {
+        // No vector kernel for 128-bit products; this scan is small next to the sums above
+        for (size_t i = begin; i < end; i++) {
+            if (ce->count[i] > 0 && ce_better(ce, i, job->worker_best[worker])) {
+                job->worker_best[worker] = i;
             }
         }
+    } else {
+        size_t best = job->kernels->argmin(ce->cost_ratio + begin, ce->count + begin, end - begin);
+        if (best != SIZE_MAX && ce_better(ce, begin + best, job->worker_best[worker])) {
+            job->worker_best[worker] = begin + best;
+        }
+    }
+    if (job->extents) {
+        trace_extent_add(&job->extents[worker], start, monotonic_seconds());
+    }
+}
 
-        // Find best facility
-        double best_cost         = INFINITY;
-        int best_facility_idx    = -1;
-        size_t best_client_count = 0;
+// A candidate set is kept until a better one turns up, so clients in it may have been assigned by later iterations.
+// Drop those from facility i's set and recompute its ratio the way evaluate_facilities() does. Returns whether the
+// set changed; an emptied set is discarded (count 0).
+static bool refresh_candidates(CostEffectivenessMatrix* ce, Data* data, const SimdKernels* kernels, const uint64_t* U,
+                               const uint64_t* opened, size_t i, Arena* scratch) {
+    size_t count = ce->count[i];
+    size_t kept  = 0;
+    for (size_t k = 0; k < count; k++) {
+        size_t client = ce->clients[i][k];
+        if (bitset_get(U, client)) {
+            ce->clients[i][kept++] = client;
+        }
+    }
+    if (kept == count) {
+        return false;
+    }
+    arrsetlen(ce->clients[i], kept);
+    ce->count[i] = kept;
+    if (kept == 0) {
+        return true;
+    }
 
-        for (size_t i = 0; i < n_facilities; i++) {
-            if (ce[i].count < 1) {
-                continue;
-            }
-            if (ce[i].cost_ratio < best_cost || (ce[i].cost_ratio == best_cost && ce[i].count > best_client_count)) {
-                best_cost         = ce[i].cost_ratio;
-                best_client_count = ce[i].count;
-                best_facility_idx = i;
-            }
+    double* costs = arena_alloc(scratch, kept * sizeof(double));
+    for (size_t k = 0; k < kept; k++) {
+        costs[k] = connection_cost(data, ce->clients[i][k], i);
+    }
+    double opening = bitset_get(opened, i) ? 0 : opening_cost(data, i);
+    if (ce->exact) {
+        int64_t cost_sum = (int64_t) opening;
+        for (size_t k = 0; k < kept; k++) {
+            cost_sum += (int64_t) costs[k];
+        }
+        ce->cost_sum[i] = cost_sum;
+    } else {
+        ce->cost_ratio[i] = (kernels->sum(costs, kept) + opening) / (double) kept;
+    }
+    return true;
+}
+
+// Facility where client adds the least cost, counting the opening cost of one that is still closed; ties go to the
+// lower position. SIZE_MAX if the client reaches no facility at a finite cost.
+static size_t cheapest_facility(Data* data, const uint64_t* opened, size_t client) {
+    bool sparse      = is_sparse(data);
+    size_t begin     = sparse ? row_begin(data, client) : 0;
+    size_t end       = sparse ? row_begin(data, client + 1) : data->n_facilities;
+    size_t best      = SIZE_MAX;
+    double best_cost = INFINITY;
+    for (size_t k = begin; k < end; k++) {
+        size_t i    = sparse ? data->cost_facilities[k] : k;
+        double cost = sparse ? data->connection_costs[k] : connection_cost(data, client, i);
+        if (!bitset_get(opened, i)) {
+            cost += opening_cost(data, i);
+        }
+        if (cost < best_cost) {
+            best      = i;
+            best_cost = cost;
         }
+    }
+    return best;
+}
+
+double monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+FlpOptions flp_default_options(void) {
+    FlpOptions options = {.rank         = RANK_LAZY,
+                          .threads      = 1,
+                          .simd         = SIMD_AUTO,
+                          .cost_type    = COST_AUTO,
+                          .exact_ratios = true,
+                          .timings      = NULL,
+                          .phase_hook   = NULL,
+                          .phase_ctx    = NULL,
+                          .trace        = NULL};
+    return options;
+}
+
+// USDT arguments are integers: ratios go out in millionths, saturated, with NaN as -1
+static int64_t probe_ratio(double ratio) {
+    if (isnan(ratio)) {
+        return -1;
+    }
+    return ratio < 9e12 ? (int64_t) llround(ratio * 1e6) : INT64_MAX;
+}
+
+static void phase_boundary(const FlpOptions* options, FlpPhase phase, bool begin) {
+    if (options->phase_hook) {
+        options->phase_hook(options->phase_ctx, phase, begin);
+    }
+}
+
+double flp(Data* data, Assignment** assignment) {
+    FlpOptions options = flp_default_options();
+    return flp_with_options(data, &options, assignment);
+}
+
+double flp_with_options(Data* data, const FlpOptions* options, Assignment** assignment) {
+    Assignment* tmp_assignment = NULL;
+    size_t n_facilities        = data->n_facilities;
+    size_t n_clients           = data->n_clients;
 
-        // Clean up temporary arrays
+    // Client positions assigned to each facility; translated to IDs in tmp_assignment at the end
+    size_t** assigned = NULL;
+
+    // Initialize assignments
+    for (size_t i = 0; i < n_facilities; i++) {
+        Assignment a = {.count = 0, .facility = data->facilities[i], .clients = NULL};
+        arrpush(tmp_assignment, a);
+        arrpush(assigned, NULL);
+    }
+
+    size_t t = 0;
+
+    // Client and facility state, one bit per position: U has a bit set while the client is unconnected
+    uint64_t* U      = bitset_alloc(n_clients, true);
+    uint64_t* opened = bitset_alloc(n_facilities, false);
+
+    // Rank the connection cost of all facility-client pairs.
+    // One entry per stored cost, laid out like the cost store: row i starts at row_begin(data, i), so a dense
+    // instance is a row-major n_clients x n_facilities matrix and a sparse one only holds each client's own list.
+    phase_boundary(options, FLP_PHASE_RANK, true);
+    double phase_start = monotonic_seconds();
+    ThreadPool* pool   = options->threads > 1 ? pool_create(options->threads) : NULL;
+    Trace* trace       = options->trace;
+    if (trace) {
+        trace_reserve_lanes(trace, pool_size(pool));
+    }
+    RankMatrix rm;
+    FACC_PROBE1(rank__start, row_begin(data, n_clients));
+    rank_matrix_build(&rm, data, options->rank, options->cost_type, pool, trace);
+    size_t n_ranks  = rm.n_ranks;
+    FACC_PROBE1(rank__end, n_ranks);
+    double rank_end = monotonic_seconds();
+    phase_boundary(options, FLP_PHASE_RANK, false);
+    phase_boundary(options, FLP_PHASE_GREEDY, true);
+    // print_cost_matrix(&rm, data); // RANK_SORT only: lazy rows can be read once
+
+    // Initialize cost effectiveness matrix
+    CostEffectivenessMatrix ce = {.threshold  = NULL,
+                                  .count      = NULL,
+                                  .cost_ratio = NULL,
+                                  .clients    = NULL,
+                                  .exact      = options->exact_ratios && exact_ratios_possible(data, rm.cost_type),
+                                  .cost_sum   = NULL};
+    arrsetlen(ce.threshold, n_facilities);
+    arrsetlen(ce.count, n_facilities);
+    arrsetlen(ce.cost_ratio, n_facilities);
+    arrsetlen(ce.cost_sum, n_facilities);
+    arrsetlen(ce.clients, n_facilities);
+    for (size_t i = 0; i < n_facilities; i++) {
+        ce.threshold[i]  = -1;
+        ce.count[i]      = 0;
+        ce.cost_ratio[i] = 0.0;
+        ce.cost_sum[i]   = 0;
+        ce.clients[i]    = NULL;
+    }
+    const SimdKernels* kernels = simd_kernels(options->simd);
+    assert(kernels && "SIMD level not supported on this CPU");
+
+    // Rank-t pick of each client and the facility buckets they are grouped into, reused every iteration
+    uint32_t* pick         = alloc_matrix(n_clients, 1, sizeof(uint32_t));
+    double* pick_cost      = alloc_matrix(n_clients, 1, sizeof(double));
+    size_t* facility_begin = alloc_matrix(n_facilities + 1, 1, sizeof(size_t));
+    size_t* worker_best    = alloc_matrix(pool_size(pool), 1, sizeof(size_t));
+    TraceExtent* extents   = trace ? calloc(pool_size(pool), sizeof(TraceExtent)) : NULL;
+    assert(((pick && pick_cost) || n_clients == 0) && facility_begin && worker_best && "Could not allocate flp state");
+
+    // Per-iteration temporaries live in an arena that is reset every iteration instead of being freed piecemeal
+    Arena scratch;
+    arena_init(&scratch);
+
+    // Greedy steps are timed on every iteration: a handful of clock reads against O(n_facilities) work
+    FlpTimings timings  = {0};
+    size_t n_unassigned = n_clients;
+    // Every iteration assigns at least one client, so this runs at most n_clients times. Once t has passed every
+    // row (n_ranks), no client picks anything and the stored candidate sets are committed until none is left.
+    while (n_unassigned > 0) {
+        double iteration_start = monotonic_seconds();
+        FACC_PROBE2(iteration__start, t, n_unassigned);
+        arena_reset(&scratch);
+
+        // Get all the pairs at rank t. Popping a lazy row is the expensive part and rows are independent, so the
+        // unassigned clients are picked in parallel, 64 per bitset word.
+        PickJob pick_job = {
+            .rm = &rm, .data = data, .U = U, .t = t, .pick = pick, .pick_cost = pick_cost, .extents = extents};
+        pool_for(pool, bitset_words(n_clients), PICK_GRAIN, pick_clients, &pick_job);
+        double picked = monotonic_seconds();
+        if (trace) {
+            trace_extents_flush(trace, "pick", extents, pool_size(pool));
+        }
+        timings.pick += picked - iteration_start;
+
+        // Group the picks by facility with a counting sort; clients stay in position order within a facility
+        memset(facility_begin, 0, (n_facilities + 1) * sizeof(size_t));
+        size_t n_picked = 0;
+        for (size_t w = 0; w < bitset_words(n_clients); w++) {
+            for (uint64_t word = U[w]; word != 0; word &= word - 1) {
+                uint32_t facility = pick[bitset_lowest(w, word)];
+                if (facility != NO_PICK) {
+                    facility_begin[facility + 1]++;
+                    n_picked++;
+                }
+            }
+        }
         for (size_t i = 0; i < n_facilities; i++) {
-            arrfree(facility_clients[i]);
-            arrfree(facility_costs[i]);
+            facility_begin[i + 1] += facility_begin[i];
+        }
+        size_t* facility_clients = arena_alloc(&scratch, n_picked * sizeof(size_t));
+        double* facility_costs   = arena_alloc(&scratch, n_picked * sizeof(double));
+        for (size_t w = 0; w < bitset_words(n_clients); w++) {
+            for (uint64_t word = U[w]; word != 0; word &= word - 1) {
+                size_t client     = bitset_lowest(w, word); // tracked by position until the final ID translation
+                uint32_t facility = pick[client];
+                if (facility == NO_PICK) {
+                    continue;
+                }
+                // facility_begin[facility] is the bucket's cursor here and ends up at the next bucket's start
+                size_t slot            = facility_begin[facility]++;
+                facility_clients[slot] = client;
+                facility_costs[slot]   = pick_cost[client];
+            }
+        }
+        // Shift the cursors back so facility i's bucket is [facility_begin[i], facility_begin[i + 1])
+        memmove(facility_begin + 1, facility_begin, n_facilities * sizeof(size_t));
+        facility_begin[0] = 0;
+        double grouped    = monotonic_seconds();
+        timings.group += grouped - picked;
+
+        // Compute cost effectiveness for each facility and find the best one, in parallel over facilities. Buckets
+        // are very uneven, so idle workers steal ranges from busy ones.
+        for (size_t w = 0; w < pool_size(pool); w++) {
+            worker_best[w] = SIZE_MAX;
+        }
+        EffectivenessJob ce_job = {.data           = data,
+                                   .kernels        = kernels,
+                                   .opened         = opened,
+                                   .ce             = &ce,
+                                   .facility_begin = facility_begin,
+                                   .clients        = facility_clients,
+                                   .costs          = facility_costs,
+                                   .t              = t,
+                                   .worker_best    = worker_best,
+                                   .extents        = extents};
+        pool_for(pool, n_facilities, EFFECTIVENESS_GRAIN, evaluate_facilities, &ce_job);
+        if (trace) {
+            trace_extents_flush(trace, "evaluate", extents, pool_size(pool));
         }
-        arrfree(facility_clients);
-        arrfree(facility_costs);
-        arrfree(facility_counts);
 
-        if (best_facility_idx == -1) {
+        // Find best facility: lowest ratio, ties to the larger set and then the lower position
+        size_t best_facility_idx = SIZE_MAX;
+        for (size_t w = 0; w < pool_size(pool); w++) {
+            if (ce_better(&ce, worker_best[w], best_facility_idx)) {
+                best_facility_idx = worker_best[w];
+            }
+        }
+        double evaluated = monotonic_seconds();
+        timings.evaluate += evaluated - grouped;
+        // Committing a stale set would assign some clients twice: refresh it and choose again until the best set
+        // is current. Only the chosen set is checked, so this costs a scan of the facilities only when one was stale.
+        while (best_facility_idx != SIZE_MAX &&
+               refresh_candidates(&ce, data, kernels, U, opened, best_facility_idx, &scratch)) {
+            best_facility_idx = SIZE_MAX;
+            for (size_t i = 0; i < n_facilities; i++) {
+                if (ce.count[i] > 0 && ce_better(&ce, i, best_facility_idx)) {
+                    best_facility_idx = i;
+                }
+            }
+        }
+        if (best_facility_idx == SIZE_MAX) {
             break;
         }
+        size_t best_client_count = ce.count[best_facility_idx];
 
         // Assign clients to best facility
-        int best_facility = ce[best_facility_idx].facility;
-        for (size_t i = 0; i < ce[best_facility_idx].count; i++) {
-            int client = ce[best_facility_idx].clients[i];
-            hmput(U, client, false);
+        for (size_t i = 0; i < best_client_count; i++) {
+            size_t client = ce.clients[best_facility_idx][i];
+            bitset_clear(U, client);
             n_unassigned--;
         }
 
         // Mark facility as opened
-        hmput(opened, best_facility, true);
+        bitset_set(opened, best_facility_idx);
 
         // Add clients to assignment - work with pointer to modify in place
         for (size_t i = 0; i < best_client_count; i++) {
-            int client_to_add = ce[best_facility_idx].clients[i];
-            arrpush((tmp_assignment)[best_facility_idx].clients, client_to_add);
+            size_t client_to_add = ce.clients[best_facility_idx][i];
+            arrpush(assigned[best_facility_idx], client_to_add);
         }
-        tmp_assignment[best_facility_idx].count = arrlen(tmp_assignment[best_facility_idx].clients);
 
-        ce[best_facility_idx].count = 0; // don't use this set again
+        FACC_PROBE4(iteration__end, t, n_unassigned, data->facilities[best_facility_idx],
+                    probe_ratio(ce_ratio(&ce, best_facility_idx)));
+        ce.count[best_facility_idx] = 0; // don't use this set again
         t++;
+
+        double iteration_end = monotonic_seconds();
+        timings.assign += iteration_end - evaluated;
+        timings.iterations++;
+        if (iteration_end - iteration_start > timings.iteration_max) {
+            timings.iteration_max = iteration_end - iteration_start;
+        }
+        if (trace) {
+            TraceEvent* span = trace_span(trace, 0, "iteration", iteration_start, iteration_end);
+            trace_arg(span, "facility", data->facilities[best_facility_idx]);
+            trace_arg(span, "cost_ratio", ce_ratio(&ce, best_facility_idx));
+            trace_arg(span, "clients", (double) best_client_count);
+        }
+    }
+
+    // Clients that no candidate set still covered when the sets ran out are connected one at a time, in position
+    // order, wherever they add the least cost
+    for (size_t w = 0; w < bitset_words(n_clients); w++) {
+        for (uint64_t word = U[w]; word != 0; word &= word - 1) {
+            size_t client   = bitset_lowest(w, word);
+            size_t facility = cheapest_facility(data, opened, client);
+            if (facility == SIZE_MAX) {
+                fprintf(stderr, "Error: Client %d cannot reach any facility\n", data->clients[client]);
+                abort();
+            }
+            bitset_set(opened, facility);
+            arrpush(assigned[facility], client);
+            n_unassigned--;
+        }
     }
 
+    double greedy_end = monotonic_seconds();
+    FACC_PROBE2(solve__end, timings.iterations, n_unassigned);
+    phase_boundary(options, FLP_PHASE_GREEDY, false);
+    phase_boundary(options, FLP_PHASE_TOTAL_COST, true);
+
     // Calculate total cost
     double total_cost = 0;
     for (size_t i = 0; i < n_facilities; i++) {
-        Assignment a = tmp_assignment[i];
-        if (a.count < 1) {
+        size_t count = arrlenu(assigned[i]);
+        if (count < 1) {
             continue;
         }
         // Add opening cost for this facility (once)
-        total_cost += opening_cost(data, a.facility);
-        // Add connection costs for all clients
-        for (size_t j = 0; j < a.count; j++) {
-            total_cost += connection_cost(data, a.clients[j], a.facility);
+        total_cost += opening_cost(data, i);
+        // Add connection costs for all clients, translating positions back to IDs for the caller
+        for (size_t j = 0; j < count; j++) {
+            total_cost += connection_cost(data, assigned[i][j], i);
+            arrpush(tmp_assignment[i].clients, data->clients[assigned[i][j]]);
         }
+        tmp_assignment[i].count = count;
+    }
+
+    phase_boundary(options, FLP_PHASE_TOTAL_COST, false);
+    if (trace) {
+        trace_span(trace, 0, "rank matrix", phase_start, rank_end);
+        trace_span(trace, 0, "total cost", greedy_end, monotonic_seconds());
+    }
+    if (options->timings) {
+        timings.rank       = rank_end - phase_start;
+        timings.greedy     = greedy_end - rank_end;
+        timings.total_cost = monotonic_seconds() - greedy_end;
+        *options->timings  = timings;
     }
 
     // Cleanup
     for (size_t i = 0; i < n_facilities; i++) {
-        arrfree(ce[i].clients);
+        arrfree(ce.clients[i]);
+        arrfree(assigned[i]);
     }
 	
 	
 	// copy tmp_assignment into assignment
     *assignment = tmp_assignment;  // Just assign the pointer
 	
-    arrfree(ce);
-    hmfree(U);
-    hmfree(opened);
+    arrfree(ce.threshold);
+    arrfree(ce.count);
+    arrfree(ce.cost_ratio);
+    arrfree(ce.cost_sum);
+    arrfree(ce.clients);
+    arrfree(assigned);
+    rank_matrix_free(&rm);
+    arena_free(&scratch);
+    free(pick);
+    free(pick_cost);
+    free(facility_begin);
+    free(worker_best);
+    free(extents);
+    pool_destroy(pool);
+    free(U);
+    free(opened);
     return total_cost;
 }
 
 #ifndef TEST_BUILD
-int main(int argc, char** argv) {
-    Data data = {0};
+// --profile report: phase durations in seconds and the process's peak RSS, as one JSON object
+static void print_profile(FILE* out, double read_seconds, const FlpTimings* timings) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    size_t n = timings->iterations;
+    fprintf(out, "{\"read_s\": %.6f, \"rank_s\": %.6f, ", read_seconds, timings->rank);
+    fprintf(out, "\"greedy\": {\"total_s\": %.6f, \"iterations\": %zu, \"iteration_mean_s\": %.9f, ", timings->greedy,
+            n, n > 0 ? (timings->pick + timings->group + timings->evaluate + timings->assign) / (double) n : 0.0);
+    fprintf(out, "\"iteration_max_s\": %.9f, \"pick_s\": %.6f, \"group_s\": %.6f, \"evaluate_s\": %.6f, ",
+            timings->iteration_max, timings->pick, timings->group, timings->evaluate);
+    fprintf(out, "\"assign_s\": %.6f}, \"total_cost_s\": %.6f, \"peak_rss_kb\": %ld}\n", timings->assign,
+            timings->total_cost, usage.ru_maxrss);
+}
 
-    // Check if a filename was provided
-    if (argc > 1) {
-        if (!read_problem_data(argv[1], &data)) {
+// --counters: hardware counter totals per phase, "read" plus the flp_with_options() phases
+#define PROFILE_N_PHASES (1 + FLP_N_PHASES)
+
+typedef struct {
+    PerfCounters counters;
+    PerfSample start;
+    PerfSample spent[PROFILE_N_PHASES];
+} CounterProfile;
+
+static void count_phase(CounterProfile* profile, size_t phase, bool begin) {
+    if (begin) {
+        perf_read(&profile->counters, &profile->start);
+        return;
+    }
+    PerfSample now;
+    perf_read(&profile->counters, &now);
+    for (int i = 0; i < PERF_N_COUNTERS; i++) {
+        // Scaled estimates of multiplexed counters can go backwards between two reads
+        uint64_t start = profile->start.value[i];
+        profile->spent[phase].value[i] += now.value[i] > start ? now.value[i] - start : 0;
+    }
+}
+
+// --alloc-stats: stb_ds allocation counts per phase, in builds with FACC_ALLOC_STATS
+typedef struct {
+    AllocStats start;
+    AllocStats spent[PROFILE_N_PHASES]; // live_bytes is the value at the end of the phase, peak_bytes its maximum
+} AllocProfile;
+
+static void alloc_phase(AllocProfile* profile, size_t phase, bool begin) {
+    if (begin) {
+        alloc_stats_reset_peak();
+        alloc_stats_read(&profile->start);
+        return;
+    }
+    AllocStats now;
+    alloc_stats_read(&now);
+    AllocStats* spent = &profile->spent[phase];
+    spent->allocations += now.allocations - profile->start.allocations;
+    spent->reallocations += now.reallocations - profile->start.reallocations;
+    spent->frees += now.frees - profile->start.frees;
+    spent->bytes += now.bytes - profile->start.bytes;
+    spent->live_bytes = now.live_bytes;
+    spent->peak_bytes = now.peak_bytes > spent->peak_bytes ? now.peak_bytes : spent->peak_bytes;
+}
+
+// Everything that watches phase boundaries, behind the one hook flp_with_options() offers
+typedef struct {
+    CounterProfile* counters; // NULL when not requested
+    AllocProfile* allocs;
+} PhaseProfiles;
+
+static void profile_phase(PhaseProfiles* profiles, size_t phase, bool begin) {
+    // Counters are read innermost so the bookkeeping of the other profiles stays out of them
+    if (profiles->allocs && begin) {
+        alloc_phase(profiles->allocs, phase, begin);
+    }
+    if (profiles->counters) {
+        count_phase(profiles->counters, phase, begin);
+    }
+    if (profiles->allocs && !begin) {
+        alloc_phase(profiles->allocs, phase, begin);
+    }
+}
+
+static void profile_flp_phase(void* ctx, FlpPhase phase, bool begin) { profile_phase(ctx, 1 + (size_t) phase, begin); }
+
+static const char* profile_phase_names[PROFILE_N_PHASES] = {"read", "rank", "greedy", "total_cost"};
+
+static void print_counters(FILE* out, const CounterProfile* profile) {
+    fprintf(out, "{\"counters\": {\"scope\": \"calling thread\"");
+    for (size_t p = 0; p < PROFILE_N_PHASES; p++) {
+        const PerfSample* spent = &profile->spent[p];
+        fprintf(out, ", \"%s\": {", profile_phase_names[p]);
+        for (int i = 0; i < PERF_N_COUNTERS; i++) {
+            fprintf(out, "%s\"%s\": ", i > 0 ? ", " : "", perf_counter_name((PerfCounterId) i));
+            if (perf_available(&profile->counters, (PerfCounterId) i)) {
+                fprintf(out, "%llu", (unsigned long long) spent->value[i]);
+            } else {
+                fprintf(out, "null");
+            }
+        }
+        if (perf_available(&profile->counters, PERF_CYCLES) && perf_available(&profile->counters, PERF_INSTRUCTIONS) &&
+            spent->value[PERF_CYCLES] > 0) {
+            fprintf(out, ", \"ipc\": %.3f",
+                    (double) spent->value[PERF_INSTRUCTIONS] / (double) spent->value[PERF_CYCLES]);
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "}}\n");
+}
+
+static void print_alloc_stats(FILE* out, const AllocProfile* profile) {
+    fprintf(out, "{\"alloc_stats\": {");
+    for (size_t p = 0; p < PROFILE_N_PHASES; p++) {
+        const AllocStats* spent = &profile->spent[p];
+        fprintf(out, "%s\"%s\": {\"allocations\": %zu, \"reallocations\": %zu, \"frees\": %zu, ", p > 0 ? ", " : "",
+                profile_phase_names[p], spent->allocations, spent->reallocations, spent->frees);
+        fprintf(out, "\"bytes\": %zu, \"live_bytes\": %zu, \"peak_bytes\": %zu}", spent->bytes, spent->live_bytes,
+                spent->peak_bytes);
+    }
+    fprintf(out, "}}\n");
+}
+
+static void print_usage(const char* program) {
+    printf("Usage: %s [options] <input_file>\n", program);
+    printf("Options:\n");
+    printf("  --rank STRATEGY   lazy (default): rank each client's facilities on demand; sort: sort them all up\n");
+    printf("                    front; transposed: sort, then store each rank of all clients contiguously\n");
+    printf("  --threads N       rank client rows and run each iteration on N threads (0 = all CPUs, default 1)\n");
+    printf("  --simd LEVEL      auto (default), scalar, avx2 or avx512 kernels for the per-iteration loops\n");
+    printf("  --cost-type TYPE  auto (default: the narrowest the costs allow), f64, f32 or i32 rank matrix costs\n");
+    printf("  --profile         print phase timings, iteration count and peak RSS as JSON on stderr\n");
+    printf("  --trace FILE      write a Chrome/Perfetto trace of the solve timeline to FILE\n");
+    printf("  --counters        print hardware counters (cycles, instructions, cache and branch misses) per phase\n");
+    printf("                    as JSON on stderr, if perf_event_open is available; only the calling thread is\n");
+    printf("                    counted, not --threads workers\n");
+    printf("  --alloc-stats     print stb_ds allocation counts, bytes and high-water mark per phase as JSON on\n");
+    printf("                    stderr (needs a build with ALLOC_STATS=1)\n");
+}
+
+int main(int argc, char** argv) {
+    Data data          = {0};
+    FlpOptions options = flp_default_options();
+    char* filename     = NULL;
+    bool profile       = false;
+    bool counters      = false;
+    bool allocs        = false;
+    char* trace_path   = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rank") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "lazy") == 0) {
+                options.rank = RANK_LAZY;
+            } else if (strcmp(argv[i], "sort") == 0) {
+                options.rank = RANK_SORT;
+            } else if (strcmp(argv[i], "transposed") == 0) {
+                options.rank = RANK_TRANSPOSED;
+            } else {
+                printf("Unknown rank strategy '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            char* end;
+            long n = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || n < 0) {
+                printf("Invalid thread count '%s'\n", argv[i]);
+                return 1;
+            }
+            options.threads = n == 0 ? pool_default_threads() : (size_t) n;
+        } else if (strcmp(argv[i], "--simd") == 0 && i + 1 < argc) {
+            const char* level = argv[++i];
+            if (strcmp(level, "auto") == 0) {
+                options.simd = SIMD_AUTO;
+            } else if (strcmp(level, "scalar") == 0) {
+                options.simd = SIMD_SCALAR;
+            } else if (strcmp(level, "avx2") == 0) {
+                options.simd = SIMD_AVX2;
+            } else if (strcmp(level, "avx512") == 0) {
+                options.simd = SIMD_AVX512;
+            } else {
+                printf("Unknown SIMD level '%s'\n", level);
+                return 1;
+            }
+            if (!simd_kernels(options.simd)) {
+                printf("SIMD level '%s' is not supported on this CPU\n", level);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cost-type") == 0 && i + 1 < argc) {
+            const char* type = argv[++i];
+            if (strcmp(type, "auto") == 0) {
+                options.cost_type = COST_AUTO;
+            } else if (strcmp(type, "f64") == 0) {
+                options.cost_type = COST_F64;
+            } else if (strcmp(type, "f32") == 0) {
+                options.cost_type = COST_F32;
+            } else if (strcmp(type, "i32") == 0) {
+                options.cost_type = COST_I32;
+            } else {
+                printf("Unknown cost type '%s'\n", type);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile = true;
+        } else if (strcmp(argv[i], "--counters") == 0) {
+            counters = true;
+        } else if (strcmp(argv[i], "--alloc-stats") == 0) {
+            allocs = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] == '-' || filename) {
+            printf("Unexpected argument '%s'\n", argv[i]);
+            print_usage(argv[0]);
             return 1;
+        } else {
+            filename = argv[i];
         }
-    } else {
+    }
+
+    // Check if a filename was provided
+    if (!filename) {
         printf("No input file provided\n");
-        printf("Usage: %s <input_file>\n", argv[0]);
+        print_usage(argv[0]);
+        return 1;
+    }
+    // Counters that cannot be opened only cost the report, never the solve
+    CounterProfile counter_profile = {0};
+    if (counters) {
+        const char* error;
+        if (!perf_open(&counter_profile.counters, &error)) {
+            fprintf(stderr, "Warning: hardware counters unavailable: %s\n", error);
+            counters = false;
+        }
+    }
+    AllocProfile alloc_profile = {0};
+    if (allocs && !alloc_stats_enabled()) {
+        fprintf(stderr, "Warning: allocation stats unavailable: built without FACC_ALLOC_STATS (make ALLOC_STATS=1)\n");
+        allocs = false;
+    }
+    PhaseProfiles profiles = {.counters = counters ? &counter_profile : NULL, .allocs = allocs ? &alloc_profile : NULL};
+    if (counters || allocs) {
+        options.phase_hook = profile_flp_phase;
+        options.phase_ctx  = &profiles;
+    }
+
+    Trace trace;
+    if (trace_path) {
+        trace_init(&trace);
+        options.trace = &trace;
+    }
+
+    double read_start = monotonic_seconds();
+    profile_phase(&profiles, 0, true);
+    if (!read_problem_data(filename, &data)) {
+        return 1;
+    }
+    profile_phase(&profiles, 0, false);
+    if (!cost_type_fits(&data, options.cost_type)) {
+        printf("The instance's costs do not all fit the requested cost type\n");
+        free_data(&data);
         return 1;
     }
+    double read_seconds = monotonic_seconds() - read_start;
+    if (trace_path) {
+        trace_span(&trace, 0, "read", read_start, read_start + read_seconds);
+    }
 
     Assignment* assignments = NULL;
+    FlpTimings timings      = {0};
+    options.timings         = profile ? &timings : NULL;
 
-    double total_cost = flp(&data, &assignments);
+    double total_cost = flp_with_options(&data, &options, &assignments);
     printf("total cost: %f\n", total_cost);
 
     print_assignment(assignments, data.n_facilities);
     free_assignments(&data, assignments);
+    free_data(&data);
 
-    return 0;
+    if (profile) {
+        fflush(stdout);
+        print_profile(stderr, read_seconds, &timings);
+    }
+    if (counters) {
+        fflush(stdout);
+        print_counters(stderr, &counter_profile);
+        perf_close(&counter_profile.counters);
+    }
+    if (allocs) {
+        fflush(stdout);
+        print_alloc_stats(stderr, &alloc_profile);
+    }
+    bool ok = true;
+    if (trace_path) {
+        ok = trace_write(&trace, trace_path);
+        trace_free(&trace);
+    }
+
+    return ok ? 0 : 1;
 }
 #endif // TEST_BUILD
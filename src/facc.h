@@ -0,0 +1,134 @@
+#ifndef FACC_H
+#define FACC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "geo.h"
+#include "simd.h"
+#include "trace.h"
+
+// Facility Location Problem: shared types and entry points
+
+typedef struct {
+    size_t count;
+    int facility;
+    int* clients; // dynamic array
+} Assignment;
+
+typedef struct {
+    const char* data;
+    size_t size;
+} MappedFile;
+
+// Type the rank matrix stores costs as. Narrower types halve the memory traffic of ranking and of the greedy loop;
+// the solution is the same for every type that holds all costs exactly.
+typedef enum {
+    COST_F64,
+    COST_F32,
+    COST_I32,
+    COST_AUTO, // FlpOptions only: data->cost_type
+} CostType;
+
+typedef struct {
+    size_t n_facilities;
+    int* facilities;
+    double* opening_costs; // dense, indexed by facility position
+    int* clients;
+    size_t n_clients;
+    double* connection_costs; // dense row-major [client][facility], indexed by position
+    // Sparse (CSR) instances: client i reaches the facility positions cost_facilities[row_offsets[i] ..
+    // row_offsets[i + 1]), in increasing order, at the matching connection_costs. Both NULL for dense instances.
+    size_t* row_offsets;
+    uint32_t* cost_facilities;
+    MappedFile mapping; // when set, the arrays above point into this read-only mapping (.faccb input)
+    CostType cost_type; // narrowest type holding every stored cost exactly, recorded by the loaders
+    // Point instances: costs come from coordinates and no cost store exists (connection_costs stays NULL)
+    GeoPoints geo;
+} Data;
+
+static inline bool is_sparse(const Data* data) { return data->row_offsets != NULL; }
+
+static inline bool is_geo(const Data* data) { return data->geo.metric != GEO_NONE; }
+
+// Index of client's first stored cost; row_begin(data, n_clients) is the number of stored costs
+static inline size_t row_begin(const Data* data, size_t client) {
+    return is_sparse(data) ? data->row_offsets[client] : client * data->n_facilities;
+}
+
+// Facility position of the stored cost at index entry, in the row starting at begin
+static inline size_t entry_facility(const Data* data, size_t begin, size_t entry) {
+    return is_sparse(data) ? data->cost_facilities[entry] : entry - begin;
+}
+
+typedef enum {
+    RANK_LAZY, // heapify each client's row, pop the next rank only when the still-unassigned client needs it
+    RANK_SORT, // sort every row up front
+    // sort every row, then store the ranks rank-major so rank t of every client is contiguous (dense instances)
+    RANK_TRANSPOSED,
+} RankStrategy;
+
+// Wall-clock seconds spent in each phase of flp_with_options()
+typedef struct {
+    double rank;       // building the rank matrix: filling every row and sorting (or heapifying) it
+    double greedy;     // the greedy loop, including setting up its state
+    double total_cost; // summing the solution's cost and translating it to client IDs
+    // The greedy loop by step, summed over its iterations
+    size_t iterations;    // facilities opened (or reopened)
+    double iteration_max; // slowest single iteration
+    double pick;          // fetching each unassigned client's rank-t pair (lazy heap pops happen here)
+    double group;         // bucketing the picks by facility
+    double evaluate;      // cost effectiveness and the best facility
+    double assign;        // connecting the best facility's clients
+} FlpTimings;
+
+typedef enum {
+    FLP_PHASE_RANK,
+    FLP_PHASE_GREEDY,
+    FLP_PHASE_TOTAL_COST,
+    FLP_N_PHASES,
+} FlpPhase;
+
+// Called on the calling thread when flp_with_options() enters (begin) and leaves each phase
+typedef void (*FlpPhaseHook)(void* ctx, FlpPhase phase, bool begin);
+
+typedef struct {
+    RankStrategy rank;
+    size_t threads; // worker threads for the parallel phases (1 = serial)
+    SimdLevel simd; // kernels for the per-iteration sums and argmin; results are identical at every level
+    CostType cost_type; // rank matrix cost storage, COST_AUTO by default; must hold the instance's costs exactly
+    bool exact_ratios;  // with integer costs (COST_I32), rank candidates by exact (sum, count) comparisons
+    FlpTimings* timings; // filled in when set
+    FlpPhaseHook phase_hook; // optional
+    void* phase_ctx;
+    Trace* trace; // spans for the rank build, every greedy iteration and the cost sum are recorded when set
+} FlpOptions;
+
+void init_data(Data* data);
+void free_data(Data* data);
+void free_assignments(Data* data, Assignment* assignments);
+
+void* alloc_matrix(size_t rows, size_t cols, size_t size);
+bool map_file(const char* filename, MappedFile* file);
+void unmap_file(MappedFile* file);
+
+bool parse_problem_text(const char* text, size_t size, Data* data);
+bool read_problem_data(char* filename, Data* data);
+size_t unreachable_client(const Data* data);
+
+double connection_cost(Data* data, size_t client, size_t facility);
+bool cost_type_fits(const Data* data, CostType cost_type);
+CostType narrowest_cost_type(const Data* data);
+double opening_cost(Data* data, size_t facility);
+double monotonic_seconds(void);
+FlpOptions flp_default_options(void);
+double flp(Data* data, Assignment** assignment);
+double flp_with_options(Data* data, const FlpOptions* options, Assignment** assignment);
+
+// Binary instance format (.faccb), see faccb.c
+bool is_problem_binary(const MappedFile* file);
+bool load_problem_binary(MappedFile* file, Data* data);
+bool write_problem_binary(const Data* data, const char* filename);
+
+#endif // FACC_H
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "facc.h"
+
+// Binary instance format (.faccb)
+//
+// A fixed little header followed by the sections below, each starting on a FACCB_ALIGN boundary so the arrays can
+// be used straight out of an mmap'd file:
+//
+//   header
+//   int32   facility IDs    [n_facilities]
+//   double  opening costs   [n_facilities]
+//   int32   client IDs      [n_clients]
+//   uint64  row offsets     [n_clients + 1]   (sparse only)
+//   uint32  cost facilities [n_costs]         (sparse only, facility positions)
+//   double  costs           [n_costs]
+//
+// Dense files store the row-major client x facility matrix (n_costs = n_clients * n_facilities). Sparse files store
+// the CSR arrays of Data as they are in memory. Values are in host byte order; byte_order lets a reader on the other
+// endianness refuse the file. The header records the narrowest CostType holding every cost (version 2), so loading
+// never has to read the costs; version 1 files, which lack it, are still read and scanned once.
+
+#define FACCB_MAGIC "FACCB\0\0\0"
+#define FACCB_VERSION 2u
+#define FACCB_BYTE_ORDER 0x01020304u
+#define FACCB_ALIGN 64u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t n_facilities;
+    uint64_t n_clients;
+    uint64_t n_costs;
+    uint32_t sparse;
+    uint32_t cost_type; // CostType, 0 in version 1 files
+    uint64_t facilities_offset;
+    uint64_t opening_costs_offset;
+    uint64_t clients_offset;
+    uint64_t row_offsets_offset;
+    uint64_t cost_facilities_offset;
+    uint64_t costs_offset;
+    uint64_t file_size;
+} FaccbHeader;
+
+_Static_assert(sizeof(size_t) == sizeof(uint64_t), ".faccb row offsets are used in place as size_t");
+_Static_assert(sizeof(int) == sizeof(int32_t), ".faccb IDs are used in place as int");
+
+static uint64_t faccb_align(uint64_t offset) { return (offset + FACCB_ALIGN - 1) & ~(uint64_t) (FACCB_ALIGN - 1); }
+
+// Lay out the sections for the given counts. Returns false if the file size would overflow.
+static bool faccb_layout(FaccbHeader* h, uint64_t n_facilities, uint64_t n_clients, uint64_t n_costs, bool sparse,
+                         CostType cost_type) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, FACCB_MAGIC, sizeof(h->magic));
+    h->version      = FACCB_VERSION;
+    h->byte_order   = FACCB_BYTE_ORDER;
+    h->n_facilities = n_facilities;
+    h->n_clients    = n_clients;
+    h->n_costs      = n_costs;
+    h->sparse       = sparse;
+    h->cost_type    = (uint32_t) cost_type;
+
+    // Keep every section size comfortably inside 64 bits
+    const uint64_t limit = UINT64_MAX / 64;
+    if (n_facilities > limit || n_clients > limit || n_costs > limit) {
+        return false;
+    }
+    if (!sparse && ((n_facilities != 0 && n_clients > limit / n_facilities) || n_costs != n_clients * n_facilities)) {
+        return false;
+    }
+    h->facilities_offset    = faccb_align(sizeof(FaccbHeader));
+    h->opening_costs_offset = faccb_align(h->facilities_offset + n_facilities * sizeof(int32_t));
+    h->clients_offset       = faccb_align(h->opening_costs_offset + n_facilities * sizeof(double));
+    uint64_t end            = h->clients_offset + n_clients * sizeof(int32_t);
+    if (sparse) {
+        h->row_offsets_offset     = faccb_align(end);
+        h->cost_facilities_offset = faccb_align(h->row_offsets_offset + (n_clients + 1) * sizeof(uint64_t));
+        end                       = h->cost_facilities_offset + n_costs * sizeof(uint32_t);
+    }
+    h->costs_offset = faccb_align(end);
+    h->file_size    = h->costs_offset + n_costs * sizeof(double);
+    return true;
+}
+
+bool is_problem_binary(const MappedFile* file) {
+    return file->size >= sizeof(FaccbHeader) && memcmp(file->data, FACCB_MAGIC, 8) == 0;
+}
+
+// The CSR arrays index everything else, so check them before trusting them
+static bool faccb_sparse_valid(const FaccbHeader* h, const char* base) {
+    const uint64_t* offsets    = (const uint64_t*) (base + h->row_offsets_offset);
+    const uint32_t* facilities = (const uint32_t*) (base + h->cost_facilities_offset);
+    if (offsets[0] != 0 || offsets[h->n_clients] != h->n_costs) {
+        return false;
+    }
+    for (uint64_t i = 0; i < h->n_clients; i++) {
+        if (offsets[i] > offsets[i + 1]) {
+            return false;
+        }
+        for (uint64_t k = offsets[i]; k < offsets[i + 1]; k++) {
+            if (facilities[k] >= h->n_facilities || (k > offsets[i] && facilities[k - 1] >= facilities[k])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Point data at the sections of a mapped .faccb file. On success data owns the mapping; on failure it is unmapped.
+bool load_problem_binary(MappedFile* file, Data* data) {
+    FaccbHeader h;
+    memcpy(&h, file->data, sizeof(h));
+
+    // The layout follows from the counts; version 1 headers differ from version 2 ones only in the version and the
+    // cost type (then 0)
+    FaccbHeader expected;
+    bool laid_out = h.sparse <= 1 && h.cost_type < COST_AUTO &&
+                    faccb_layout(&expected, h.n_facilities, h.n_clients, h.n_costs, h.sparse, (CostType) h.cost_type);
+    expected.version = h.version;
+    bool ok          = true;
+    if (h.version != FACCB_VERSION && h.version != 1) {
+        fprintf(stderr, "Error: Unsupported .faccb version %u\n", h.version);
+        ok = false;
+    } else if (h.byte_order != FACCB_BYTE_ORDER) {
+        fprintf(stderr, "Error: .faccb file was written on a machine with a different byte order\n");
+        ok = false;
+    } else if (!laid_out || memcmp(&expected, &h, sizeof(h)) != 0 || h.file_size > file->size ||
+               (h.sparse && !faccb_sparse_valid(&h, file->data))) {
+        fprintf(stderr, "Error: Corrupt or truncated .faccb file\n");
+        ok = false;
+    } else if (h.n_facilities > SIZE_MAX || h.n_clients > SIZE_MAX) {
+        fprintf(stderr, "Error: .faccb instance is too large for this platform\n");
+        ok = false;
+    }
+    if (!ok) {
+        unmap_file(file);
+        return false;
+    }
+
+    // Rows are read front to back while ranking, then randomly; let the kernel start paging everything in
+    madvise((void*) file->data, file->size, MADV_WILLNEED);
+
+    const char* base       = file->data;
+    data->n_facilities     = (size_t) h.n_facilities;
+    data->n_clients        = (size_t) h.n_clients;
+    data->facilities       = (int*) (base + h.facilities_offset);
+    data->opening_costs    = (double*) (base + h.opening_costs_offset);
+    data->clients          = (int*) (base + h.clients_offset);
+    data->connection_costs = (double*) (base + h.costs_offset);
+    if (h.sparse) {
+        data->row_offsets     = (size_t*) (base + h.row_offsets_offset);
+        data->cost_facilities = (uint32_t*) (base + h.cost_facilities_offset);
+    }
+    data->mapping   = *file;
+    // A declared cost type is checked against the costs, since the rank matrix converts them to it unchecked
+    data->cost_type = COST_F64;
+    if (h.version == 1) {
+        data->cost_type = narrowest_cost_type(data);
+    } else if (!cost_type_fits(data, (CostType) h.cost_type)) {
+        fprintf(stderr, "Error: Corrupt .faccb file: costs do not fit the declared cost type\n");
+        free_data(data);
+        return false;
+    } else {
+        data->cost_type = (CostType) h.cost_type;
+    }
+    return true;
+}
+
+static bool write_padding(FILE* fp, uint64_t* written, uint64_t offset) {
+    static const char zeros[FACCB_ALIGN] = {0};
+    size_t n                             = (size_t) (offset - *written);
+    *written                             = offset;
+    return fwrite(zeros, 1, n, fp) == n;
+}
+
+static bool write_section(FILE* fp, uint64_t* written, uint64_t offset, const void* src, size_t size, size_t count) {
+    if (!write_padding(fp, written, offset)) {
+        return false;
+    }
+    *written += size * count;
+    return count == 0 || fwrite(src, size, count, fp) == count;
+}
+
+bool write_problem_binary(const Data* data, const char* filename) {
+    if (is_geo(data)) {
+        fprintf(stderr, "Error: Point instances have no .faccb form\n");
+        return false;
+    }
+    FaccbHeader h;
+    bool sparse    = is_sparse(data);
+    size_t n_costs = row_begin(data, data->n_clients);
+    // The writer reads every cost anyway; the reader then gets the rank matrix type for free
+    if (!faccb_layout(&h, data->n_facilities, data->n_clients, n_costs, sparse, narrowest_cost_type(data))) {
+        fprintf(stderr, "Error: Instance too large for .faccb\n");
+        return false;
+    }
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not open file '%s' for writing\n", filename);
+        return false;
+    }
+
+    uint64_t written = sizeof(h);
+    bool ok          = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+              write_section(fp, &written, h.facilities_offset, data->facilities, sizeof(int32_t), data->n_facilities) &&
+              write_section(fp, &written, h.opening_costs_offset, data->opening_costs, sizeof(double),
+                            data->n_facilities) &&
+              write_section(fp, &written, h.clients_offset, data->clients, sizeof(int32_t), data->n_clients);
+    if (sparse) {
+        ok = ok &&
+             write_section(fp, &written, h.row_offsets_offset, data->row_offsets, sizeof(uint64_t),
+                           data->n_clients + 1) &&
+             write_section(fp, &written, h.cost_facilities_offset, data->cost_facilities, sizeof(uint32_t), n_costs);
+    }
+    ok = ok && write_section(fp, &written, h.costs_offset, data->connection_costs, sizeof(double), n_costs);
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write file '%s'\n", filename);
+    }
+    return ok;
+}
@@ -0,0 +1,320 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "gen.h"
+
+#define PLANE_SIZE 1000.0
+#define FACILITIES_PER_CLUSTER 100
+#define CLUSTER_SPREAD 40.0
+
+typedef struct {
+    const GenSpec* spec;
+    uint64_t s[4];        // xoshiro256** state
+    double* facility_xy;  // x, y per facility; plane layouts only
+    double* client_xy;    // x, y per client; plane layouts only
+    unsigned char* taken; // per facility, marks the current sparse row's picks
+} Generator;
+
+static uint64_t splitmix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15u);
+    z          = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+    z          = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+    return z ^ (z >> 31);
+}
+
+static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+static uint64_t next_u64(Generator* g) {
+    uint64_t* s    = g->s;
+    uint64_t value = rotl(s[1] * 5, 7) * 9;
+    uint64_t t     = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return value;
+}
+
+// In [0, 1)
+static double next_unit(Generator* g) { return (double) (next_u64(g) >> 11) * 0x1.0p-53; }
+
+// In [0, n); the modulo bias is far below anything an instance could show
+static size_t next_below(Generator* g, size_t n) { return (size_t) (next_u64(g) % n); }
+
+// Roughly normal with mean 0 and standard deviation 1 (Irwin-Hall), from arithmetic only so every platform agrees
+static double next_normal(Generator* g) {
+    double sum = 0;
+    for (int i = 0; i < 12; i++) {
+        sum += next_unit(g);
+    }
+    return sum - 6.0;
+}
+
+static void place_points(Generator* g, double* xy, size_t n, const double* centres, size_t n_centres) {
+    for (size_t i = 0; i < n; i++) {
+        if (centres) {
+            const double* c = &centres[2 * next_below(g, n_centres)];
+            xy[2 * i]       = c[0] + CLUSTER_SPREAD * next_normal(g);
+            xy[2 * i + 1]   = c[1] + CLUSTER_SPREAD * next_normal(g);
+        } else {
+            xy[2 * i]     = PLANE_SIZE * next_unit(g);
+            xy[2 * i + 1] = PLANE_SIZE * next_unit(g);
+        }
+    }
+}
+
+static void generator_init(Generator* g, const GenSpec* spec) {
+    memset(g, 0, sizeof(*g));
+    g->spec       = spec;
+    uint64_t seed = spec->seed;
+    for (int i = 0; i < 4; i++) {
+        g->s[i] = splitmix64(&seed);
+    }
+    g->taken = calloc(spec->n_facilities > 0 ? spec->n_facilities : 1, 1);
+    assert(g->taken && "Could not allocate generator");
+
+    switch (spec->costs) {
+    case GEN_COSTS_UNIFORM:
+        break;
+    case GEN_COSTS_EUCLIDEAN:
+    case GEN_COSTS_CLUSTERED: {
+        g->facility_xy = alloc_matrix(spec->n_facilities, 2, sizeof(double));
+        g->client_xy   = alloc_matrix(spec->n_clients, 2, sizeof(double));
+        assert((g->facility_xy || spec->n_facilities == 0) && (g->client_xy || spec->n_clients == 0) &&
+               "Could not allocate generator");
+        double* centres  = NULL;
+        size_t n_centres = 1 + spec->n_facilities / FACILITIES_PER_CLUSTER;
+        if (spec->costs == GEN_COSTS_CLUSTERED) {
+            centres = alloc_matrix(n_centres, 2, sizeof(double));
+            assert(centres && "Could not allocate generator");
+            place_points(g, centres, n_centres, NULL, 0);
+        }
+        place_points(g, g->facility_xy, spec->n_facilities, centres, n_centres);
+        place_points(g, g->client_xy, spec->n_clients, centres, n_centres);
+        free(centres);
+        break;
+    }
+    default:
+        assert(false && "Unknown cost layout");
+    }
+}
+
+static void generator_free(Generator* g) {
+    free(g->facility_xy);
+    free(g->client_xy);
+    free(g->taken);
+}
+
+static int next_opening_cost(Generator* g) {
+    switch (g->spec->opening) {
+    case GEN_OPENING_UNIFORM:
+        return 500 + (int) next_below(g, 4500);
+    case GEN_OPENING_HEAVY_TAILED: {
+        double cost = 500.0 * pow(1.0 - next_unit(g), -1.0 / 1.2);
+        return cost < 1e7 ? (int) cost : 10000000;
+    }
+    default:
+        assert(false && "Unknown opening cost distribution");
+        return 0;
+    }
+}
+
+static int connection(Generator* g, size_t client, size_t facility) {
+    if (g->spec->costs == GEN_COSTS_UNIFORM) {
+        return 1 + (int) next_below(g, 1000);
+    }
+    double dx = g->client_xy[2 * client] - g->facility_xy[2 * facility];
+    double dy = g->client_xy[2 * client + 1] - g->facility_xy[2 * facility + 1];
+    return 1 + (int) sqrt(dx * dx + dy * dy);
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*) a;
+    uint32_t y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+// Fill client's row: every facility in order when dense, otherwise per_client distinct ones in increasing order.
+// Returns the number of entries.
+static size_t next_row(Generator* g, size_t client, uint32_t* facilities, int* costs) {
+    size_t n_f = g->spec->n_facilities;
+    size_t k   = g->spec->per_client;
+    if (k == 0 || k >= n_f) {
+        for (size_t f = 0; f < n_f; f++) {
+            facilities[f] = (uint32_t) f;
+            costs[f]      = connection(g, client, f);
+        }
+        return n_f;
+    }
+
+    // Floyd's sampling: k distinct positions with exactly k draws
+    for (size_t j = n_f - k, n = 0; j < n_f; j++, n++) {
+        size_t pick    = next_below(g, j + 1);
+        pick           = g->taken[pick] ? j : pick;
+        g->taken[pick] = 1;
+        facilities[n]  = (uint32_t) pick;
+    }
+    qsort(facilities, k, sizeof(uint32_t), compare_u32);
+    for (size_t n = 0; n < k; n++) {
+        g->taken[facilities[n]] = 0;
+        costs[n]                = connection(g, client, facilities[n]);
+    }
+    return k;
+}
+
+// Buffered writer for the text format; fprintf per number is the bottleneck at 10^9 costs
+typedef struct {
+    FILE* f;
+    char buf[1 << 16];
+    size_t len;
+    bool ok;
+} Writer;
+
+static void writer_flush(Writer* w) {
+    if (w->len > 0 && fwrite(w->buf, 1, w->len, w->f) != w->len) {
+        w->ok = false;
+    }
+    w->len = 0;
+}
+
+static void put_char(Writer* w, char c) {
+    if (w->len == sizeof(w->buf)) {
+        writer_flush(w);
+    }
+    w->buf[w->len++] = c;
+}
+
+static void put_uint(Writer* w, uint64_t value) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (n > 0) {
+        put_char(w, digits[--n]);
+    }
+}
+
+// "1 2 ... n" on one line
+static void put_ids(Writer* w, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0) {
+            put_char(w, ' ');
+        }
+        put_uint(w, i + 1);
+    }
+    put_char(w, '\n');
+}
+
+GenSpec gen_default_spec(void) {
+    GenSpec spec = {.seed         = 1,
+                    .n_facilities = 1000,
+                    .n_clients    = 1000,
+                    .costs        = GEN_COSTS_UNIFORM,
+                    .opening      = GEN_OPENING_UNIFORM,
+                    .per_client   = 0};
+    return spec;
+}
+
+bool gen_write_text(const GenSpec* spec, FILE* f) {
+    Generator g;
+    generator_init(&g, spec);
+    Writer* w = malloc(sizeof(Writer));
+    assert(w && "Could not allocate generator");
+    w->f   = f;
+    w->len = 0;
+    w->ok  = true;
+
+    put_ids(w, spec->n_facilities);
+    for (size_t i = 0; i < spec->n_facilities; i++) {
+        if (i > 0) {
+            put_char(w, ' ');
+        }
+        put_uint(w, (uint64_t) next_opening_cost(&g));
+    }
+    put_char(w, '\n');
+    put_ids(w, spec->n_clients);
+
+    uint32_t* facilities = alloc_matrix(spec->n_facilities > 0 ? spec->n_facilities : 1, 1, sizeof(uint32_t));
+    int* costs           = alloc_matrix(spec->n_facilities > 0 ? spec->n_facilities : 1, 1, sizeof(int));
+    assert(facilities && costs && "Could not allocate generator");
+    bool sparse = spec->per_client > 0;
+    for (size_t client = 0; client < spec->n_clients && w->ok; client++) {
+        size_t len = next_row(&g, client, facilities, costs);
+        for (size_t n = 0; n < len; n++) {
+            if (n > 0) {
+                put_char(w, ' ');
+            }
+            if (sparse) {
+                put_uint(w, facilities[n] + 1);
+                put_char(w, ':');
+            }
+            put_uint(w, (uint64_t) costs[n]);
+        }
+        put_char(w, '\n');
+    }
+    writer_flush(w);
+
+    bool ok = w->ok;
+    free(facilities);
+    free(costs);
+    free(w);
+    generator_free(&g);
+    return ok;
+}
+
+bool gen_build(const GenSpec* spec, Data* data) {
+    assert(spec->n_facilities <= INT32_MAX && spec->n_clients <= INT32_MAX && "Too many facilities or clients");
+    Generator g;
+    generator_init(&g, spec);
+
+    init_data(data);
+    data->n_facilities = spec->n_facilities;
+    data->n_clients    = spec->n_clients;
+    data->cost_type    = COST_I32;
+    for (size_t i = 0; i < spec->n_facilities; i++) {
+        arrpush(data->facilities, (int) i + 1);
+    }
+    for (size_t i = 0; i < spec->n_facilities; i++) {
+        arrpush(data->opening_costs, (double) next_opening_cost(&g));
+    }
+    for (size_t i = 0; i < spec->n_clients; i++) {
+        arrpush(data->clients, (int) i + 1);
+    }
+
+    uint32_t* facilities = alloc_matrix(spec->n_facilities > 0 ? spec->n_facilities : 1, 1, sizeof(uint32_t));
+    int* costs           = alloc_matrix(spec->n_facilities > 0 ? spec->n_facilities : 1, 1, sizeof(int));
+    assert(facilities && costs && "Could not allocate generator");
+    bool sparse = spec->per_client > 0;
+    if (!sparse) {
+        data->connection_costs = alloc_matrix(spec->n_clients, spec->n_facilities, sizeof(double));
+        assert((data->connection_costs || spec->n_clients * spec->n_facilities == 0) &&
+               "Could not allocate connection costs");
+    } else {
+        arrpush(data->row_offsets, 0);
+    }
+    for (size_t client = 0; client < spec->n_clients; client++) {
+        size_t len = next_row(&g, client, facilities, costs);
+        for (size_t n = 0; n < len; n++) {
+            if (sparse) {
+                arrpush(data->cost_facilities, facilities[n]);
+                arrpush(data->connection_costs, (double) costs[n]);
+            } else {
+                data->connection_costs[client * spec->n_facilities + n] = (double) costs[n];
+            }
+        }
+        if (sparse) {
+            arrpush(data->row_offsets, arrlenu(data->connection_costs));
+        }
+    }
+
+    free(facilities);
+    free(costs);
+    generator_free(&g);
+    return true;
+}
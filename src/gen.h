@@ -0,0 +1,40 @@
+#ifndef GEN_H
+#define GEN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "facc.h"
+
+// Deterministic random instances. The same spec always produces the same instance, whether it is streamed out as text
+// or built in memory (for .faccb output or benchmarks).
+
+typedef enum {
+    GEN_COSTS_UNIFORM,   // independent costs in [1, 1000]
+    GEN_COSTS_EUCLIDEAN, // facilities and clients uniform on a 1000 x 1000 plane, cost = 1 + distance
+    GEN_COSTS_CLUSTERED, // like euclidean, but points gather around one centre per 100 facilities
+} GenCosts;
+
+typedef enum {
+    GEN_OPENING_UNIFORM,      // in [500, 5000)
+    GEN_OPENING_HEAVY_TAILED, // Pareto from 500 (alpha 1.2), capped at 10^7: a few facilities are very expensive
+} GenOpening;
+
+typedef struct {
+    uint64_t seed;
+    size_t n_facilities;
+    size_t n_clients;
+    GenCosts costs;
+    GenOpening opening;
+    size_t per_client; // sparse instance listing this many random facilities per client; 0 = dense
+} GenSpec;
+
+GenSpec gen_default_spec(void);
+
+// Stream the instance to f in the text format, one client row at a time
+bool gen_write_text(const GenSpec* spec, FILE* f);
+// Build the instance into data, owning its arrays like a parsed text instance (free with free_data)
+bool gen_build(const GenSpec* spec, Data* data);
+
+#endif // GEN_H
@@ -0,0 +1,261 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include "arena.h"
+#include "facc.h"
+#include "geo.h"
+
+#define GEO_LEAF_SIZE 8
+#define GEO_DEGREES (3.14159265358979323846 / 180)
+
+// Children of an inner node cover [begin, mid) and [mid, end) of the tree order, each inside its bounding box
+struct GeoNode {
+    uint32_t begin;
+    uint32_t end;
+    uint32_t left; // 0 for a leaf: the root is nobody's child
+    uint32_t right;
+    double lo[GEO_MAX_DIM];
+    double hi[GEO_MAX_DIM];
+};
+
+void geo_push_point(const GeoPoints* geo, double** points, double a, double b) {
+    assert(isfinite(a) && isfinite(b) && "Point coordinates must be finite");
+    if (geo->metric == GEO_HAVERSINE) {
+        assert(a >= -90 && a <= 90 && "Latitude must be within [-90, 90] degrees");
+        double lat = a * GEO_DEGREES;
+        double lon = b * GEO_DEGREES;
+        arrpush(*points, cos(lat) * cos(lon));
+        arrpush(*points, cos(lat) * sin(lon));
+        arrpush(*points, sin(lat));
+        return;
+    }
+    arrpush(*points, a);
+    arrpush(*points, b);
+}
+
+// Straight-line distance, summed in dimension order. Every cost, in the tree or not, goes through here with the
+// client first, so a facility's cost is the same bit pattern however it is reached.
+static inline double chord(const double* client, const double* facility, size_t dim) {
+    double sum = 0;
+    for (size_t d = 0; d < dim; d++) {
+        double diff = client[d] - facility[d];
+        sum += diff * diff;
+    }
+    return sqrt(sum);
+}
+
+// Non-decreasing in the chord (rate >= 0), which is what lets the tree prune with bounding boxes
+static inline double cost_of_chord(const GeoPoints* geo, double c) {
+    if (geo->metric == GEO_HAVERSINE) {
+        double half = c / 2;
+        return geo->rate * 2 * GEO_EARTH_RADIUS_KM * asin(half < 1 ? half : 1);
+    }
+    return geo->rate * c;
+}
+
+double geo_cost(const GeoPoints* geo, size_t client, size_t facility) {
+    return cost_of_chord(
+        geo, chord(&geo->client_points[client * geo->dim], &geo->facility_points[facility * geo->dim], geo->dim));
+}
+
+static void swap_entries(GeoTree* tree, size_t i, size_t j) {
+    uint32_t position = tree->order[i];
+    tree->order[i]    = tree->order[j];
+    tree->order[j]    = position;
+    for (size_t d = 0; d < tree->dim; d++) {
+        double x                        = tree->points[i * tree->dim + d];
+        tree->points[i * tree->dim + d] = tree->points[j * tree->dim + d];
+        tree->points[j * tree->dim + d] = x;
+    }
+}
+
+// Quickselect on coordinate d: afterwards [begin, nth) <= nth <= [nth + 1, end). Three-way partitions keep runs of
+// equal coordinates (stacked points) linear.
+static void select_nth(GeoTree* tree, size_t begin, size_t end, size_t nth, size_t d) {
+    size_t dim = tree->dim;
+    while (end - begin > 1) {
+        double a     = tree->points[begin * dim + d];
+        double b     = tree->points[(begin + (end - begin) / 2) * dim + d];
+        double c     = tree->points[(end - 1) * dim + d];
+        double pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+        size_t lt    = begin;
+        size_t i     = begin;
+        size_t gt    = end;
+        while (i < gt) {
+            double x = tree->points[i * dim + d];
+            if (x < pivot) {
+                swap_entries(tree, lt++, i++);
+            } else if (x > pivot) {
+                swap_entries(tree, i, --gt);
+            } else {
+                i++;
+            }
+        }
+        if (nth < lt) {
+            end = lt;
+        } else if (nth >= gt) {
+            begin = gt;
+        } else {
+            return;
+        }
+    }
+}
+
+static uint32_t build_node(GeoTree* tree, uint32_t begin, uint32_t end) {
+    size_t dim   = tree->dim;
+    GeoNode node = {.begin = begin, .end = end, .left = 0, .right = 0};
+    for (size_t d = 0; d < dim; d++) {
+        node.lo[d] = INFINITY;
+        node.hi[d] = -INFINITY;
+    }
+    for (size_t i = begin; i < end; i++) {
+        for (size_t d = 0; d < dim; d++) {
+            double x   = tree->points[i * dim + d];
+            node.lo[d] = x < node.lo[d] ? x : node.lo[d];
+            node.hi[d] = x > node.hi[d] ? x : node.hi[d];
+        }
+    }
+    uint32_t index = (uint32_t) arrlenu(tree->nodes);
+    arrpush(tree->nodes, node);
+    if (end - begin <= GEO_LEAF_SIZE) {
+        return index;
+    }
+
+    // Split the widest side at the median
+    size_t widest = 0;
+    for (size_t d = 1; d < dim; d++) {
+        widest = node.hi[d] - node.lo[d] > node.hi[widest] - node.lo[widest] ? d : widest;
+    }
+    uint32_t mid = begin + (end - begin) / 2;
+    select_nth(tree, begin, end, mid, widest);
+    uint32_t left            = build_node(tree, begin, mid);
+    uint32_t right           = build_node(tree, mid, end);
+    tree->nodes[index].left  = left; // arrpush may have moved the array
+    tree->nodes[index].right = right;
+    return index;
+}
+
+void geo_tree_build(GeoTree* tree, const GeoPoints* geo, size_t n_facilities) {
+    assert(n_facilities <= UINT32_MAX && "Too many facilities for the point index");
+    tree->dim    = geo->dim;
+    tree->order  = alloc_matrix(n_facilities, 1, sizeof(uint32_t));
+    tree->points = alloc_matrix(n_facilities, geo->dim, sizeof(double));
+    tree->nodes  = NULL;
+    assert(((tree->order && tree->points) || n_facilities == 0) && "Could not allocate point index");
+    for (size_t i = 0; i < n_facilities; i++) {
+        tree->order[i] = (uint32_t) i;
+        for (size_t d = 0; d < geo->dim; d++) {
+            tree->points[i * geo->dim + d] = geo->facility_points[i * geo->dim + d];
+        }
+    }
+    if (n_facilities > 0) {
+        build_node(tree, 0, (uint32_t) n_facilities);
+    }
+}
+
+void geo_tree_free(GeoTree* tree) {
+    free(tree->order);
+    free(tree->points);
+    arrfree(tree->nodes);
+    tree->order  = NULL;
+    tree->points = NULL;
+}
+
+typedef struct {
+    const GeoTree* tree;
+    const GeoPoints* geo;
+    const double* query;
+    bool started; // false: no after key, rank from the nearest facility
+    double after_cost;
+    uint32_t after_facility;
+    GeoNeighbor* best; // sorted, nearest first
+    size_t n_best;
+    size_t k;
+} GeoSearch;
+
+// Rank order of the cost matrix rows: cost, then facility position
+static inline bool ranks_before(double cost_a, uint32_t facility_a, double cost_b, uint32_t facility_b) {
+    return cost_a < cost_b || (!(cost_b < cost_a) && facility_a < facility_b);
+}
+
+// Whether anything in the node can still make it into the result; *near_cost is its lowest possible cost
+static bool node_useful(const GeoSearch* s, const GeoNode* node, double* near_cost) {
+    size_t dim  = s->tree->dim;
+    double near = 0;
+    double far  = 0;
+    for (size_t d = 0; d < dim; d++) {
+        double q     = s->query[d];
+        double gap   = q < node->lo[d] ? node->lo[d] - q : (q > node->hi[d] ? q - node->hi[d] : 0);
+        double below = q - node->lo[d];
+        double above = node->hi[d] - q;
+        double span  = below > above ? below : above;
+        near += gap * gap;
+        far += span * span;
+    }
+    *near_cost = cost_of_chord(s->geo, sqrt(near));
+    if (s->n_best == s->k && s->best[s->k - 1].cost < *near_cost) {
+        return false;
+    }
+    // Everything in the box ranks at or before the after key: already handed out
+    return !s->started || !(cost_of_chord(s->geo, sqrt(far)) < s->after_cost);
+}
+
+static void search_leaf(GeoSearch* s, const GeoNode* node) {
+    const GeoTree* tree = s->tree;
+    for (size_t i = node->begin; i < node->end; i++) {
+        uint32_t facility = tree->order[i];
+        double cost       = cost_of_chord(s->geo, chord(s->query, &tree->points[i * tree->dim], tree->dim));
+        if (s->started && !ranks_before(s->after_cost, s->after_facility, cost, facility)) {
+            continue;
+        }
+        if (s->n_best == s->k && !ranks_before(cost, facility, s->best[s->k - 1].cost, s->best[s->k - 1].facility)) {
+            continue;
+        }
+        size_t at = s->n_best < s->k ? s->n_best++ : s->k - 1;
+        while (at > 0 && ranks_before(cost, facility, s->best[at - 1].cost, s->best[at - 1].facility)) {
+            s->best[at] = s->best[at - 1];
+            at--;
+        }
+        s->best[at] = (GeoNeighbor){.facility = facility, .cost = cost};
+    }
+}
+
+static void search_node(GeoSearch* s, uint32_t index) {
+    const GeoNode* node = &s->tree->nodes[index];
+    if (node->left == 0) {
+        search_leaf(s, node);
+        return;
+    }
+    // Nearer child first, so the far one is usually pruned by the time it is reached
+    double left_cost, right_cost;
+    bool left_useful  = node_useful(s, &s->tree->nodes[node->left], &left_cost);
+    bool right_useful = node_useful(s, &s->tree->nodes[node->right], &right_cost);
+    uint32_t first    = right_cost < left_cost ? node->right : node->left;
+    uint32_t second   = right_cost < left_cost ? node->left : node->right;
+    bool second_ok    = right_cost < left_cost ? left_useful : right_useful;
+    if (right_cost < left_cost ? right_useful : left_useful) {
+        search_node(s, first);
+    }
+    double near_cost;
+    if (second_ok && node_useful(s, &s->tree->nodes[second], &near_cost)) {
+        search_node(s, second);
+    }
+}
+
+size_t geo_tree_next(const GeoTree* tree, const GeoPoints* geo, size_t client, double after_cost,
+                     uint32_t after_facility, GeoNeighbor* out, size_t k) {
+    GeoSearch s = {.tree           = tree,
+                   .geo            = geo,
+                   .query          = &geo->client_points[client * geo->dim],
+                   .started        = after_facility != UINT32_MAX,
+                   .after_cost     = after_cost,
+                   .after_facility = after_facility,
+                   .best           = out,
+                   .n_best         = 0,
+                   .k              = k};
+    double near_cost;
+    if (k > 0 && arrlenu(tree->nodes) > 0 && node_useful(&s, &tree->nodes[0], &near_cost)) {
+        search_node(&s, 0);
+    }
+    return s.n_best;
+}
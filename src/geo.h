@@ -0,0 +1,57 @@
+#ifndef GEO_H
+#define GEO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Point instances: facilities and clients are points and a connection costs rate * distance, computed when asked for
+// instead of being stored. A k-d tree over the facilities hands each client its facilities nearest first, so the
+// n_clients x n_facilities matrix never exists.
+
+typedef enum {
+    GEO_NONE,      // a cost-matrix instance
+    GEO_EUCLIDEAN, // x y on a plane
+    GEO_HAVERSINE, // latitude longitude in degrees, great-circle distance in km
+} GeoMetric;
+
+#define GEO_MAX_DIM 3
+#define GEO_EARTH_RADIUS_KM 6371.0
+
+typedef struct {
+    GeoMetric metric;
+    double rate;             // cost per unit of distance
+    size_t dim;              // coordinates per point: 2 on the plane, 3 (unit vectors) on the sphere
+    double* facility_points; // stb_ds arrays of dim coordinates per position
+    double* client_points;
+} GeoPoints;
+
+// Append one input point, converted to the stored coordinates (unit vectors for GEO_HAVERSINE)
+void geo_push_point(const GeoPoints* geo, double** points, double a, double b);
+// Connection cost of client and facility (positions)
+double geo_cost(const GeoPoints* geo, size_t client, size_t facility);
+
+typedef struct GeoNode GeoNode;
+
+typedef struct {
+    size_t dim;
+    uint32_t* order; // facility positions, permuted so that every node covers a contiguous range
+    double* points;  // their coordinates in the same order
+    GeoNode* nodes;  // stb_ds array, nodes[0] is the root
+} GeoTree;
+
+typedef struct {
+    uint32_t facility;
+    double cost;
+} GeoNeighbor;
+
+void geo_tree_build(GeoTree* tree, const GeoPoints* geo, size_t n_facilities);
+void geo_tree_free(GeoTree* tree);
+
+// The up to k facilities nearest to client that rank after (after_cost, after_facility), nearest first: ordered by
+// cost, then position, like the rows of a cost matrix. With after_facility == UINT32_MAX the ranking starts at the
+// beginning. Returns how many were found. Safe to call from several threads at once.
+size_t geo_tree_next(const GeoTree* tree, const GeoPoints* geo, size_t client, double after_cost,
+                     uint32_t after_facility, GeoNeighbor* out, size_t k);
+
+#endif // GEO_H
@@ -0,0 +1,107 @@
+#include <string.h>
+#include <unistd.h>
+#include "perf.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[PERF_N_COUNTERS] = {
+    [PERF_CYCLES]        = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [PERF_INSTRUCTIONS]  = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    [PERF_L1D_MISSES]    = {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    [PERF_LLC_MISSES]    = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    [PERF_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int open_event(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = type;
+    attr.config         = config;
+    attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1; // allowed at the default perf_event_paranoid level
+    attr.exclude_hv     = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+bool perf_open(PerfCounters* counters, const char** error) {
+    bool any = false;
+    int err  = 0;
+    for (int i = 0; i < PERF_N_COUNTERS; i++) {
+        counters->fd[i] = open_event(events[i].type, events[i].config);
+        if (counters->fd[i] >= 0) {
+            any = true;
+        } else {
+            err = errno;
+        }
+    }
+    if (!any) {
+        *error = err == EACCES || err == EPERM ? "not permitted (see /proc/sys/kernel/perf_event_paranoid)"
+                                               : "not supported by this kernel or CPU";
+    }
+    return any;
+}
+
+void perf_read(const PerfCounters* counters, PerfSample* sample) {
+    for (int i = 0; i < PERF_N_COUNTERS; i++) {
+        uint64_t values[3]; // value, time enabled, time running
+        sample->value[i] = 0;
+        if (counters->fd[i] < 0 || read(counters->fd[i], values, sizeof(values)) != (ssize_t) sizeof(values)) {
+            continue;
+        }
+        sample->value[i] = values[2] > 0 && values[2] < values[1]
+                               ? (uint64_t) ((double) values[0] * (double) values[1] / (double) values[2])
+                               : values[0];
+    }
+}
+#else
+bool perf_open(PerfCounters* counters, const char** error) {
+    for (int i = 0; i < PERF_N_COUNTERS; i++) {
+        counters->fd[i] = -1;
+    }
+    *error = "only available on Linux";
+    return false;
+}
+
+void perf_read(const PerfCounters* counters, PerfSample* sample) {
+    (void) counters;
+    memset(sample, 0, sizeof(*sample));
+}
+#endif
+
+void perf_close(PerfCounters* counters) {
+    for (int i = 0; i < PERF_N_COUNTERS; i++) {
+        if (counters->fd[i] >= 0) {
+            close(counters->fd[i]);
+        }
+        counters->fd[i] = -1;
+    }
+}
+
+bool perf_available(const PerfCounters* counters, PerfCounterId id) { return counters->fd[id] >= 0; }
+
+const char* perf_counter_name(PerfCounterId id) {
+    switch (id) {
+    case PERF_CYCLES:
+        return "cycles";
+    case PERF_INSTRUCTIONS:
+        return "instructions";
+    case PERF_L1D_MISSES:
+        return "l1d_misses";
+    case PERF_LLC_MISSES:
+        return "llc_misses";
+    case PERF_BRANCH_MISSES:
+        return "branch_misses";
+    case PERF_N_COUNTERS:
+    default:
+        return "unknown";
+    }
+}
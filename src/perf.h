@@ -0,0 +1,37 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Hardware performance counters via perf_event_open (Linux), user space only. Counters follow the thread that opens
+// them: pool workers are not included (an inherited counter would only fold their counts in when they exit, long after
+// the phase they belong to). Each counter is opened on its own; one the kernel or the CPU refuses is simply left out,
+// and on other platforms none are available.
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES, // L1 data cache read misses
+    PERF_LLC_MISSES, // last-level cache misses
+    PERF_BRANCH_MISSES,
+    PERF_N_COUNTERS,
+} PerfCounterId;
+
+typedef struct {
+    int fd[PERF_N_COUNTERS]; // -1 if unavailable
+} PerfCounters;
+
+// Counter totals at one point in time, scaled up when the kernel had to multiplex them
+typedef struct {
+    uint64_t value[PERF_N_COUNTERS];
+} PerfSample;
+
+// Open and start every counter available. Returns false, with the reason in *error, if none could be opened.
+bool perf_open(PerfCounters* counters, const char** error);
+void perf_close(PerfCounters* counters);
+bool perf_available(const PerfCounters* counters, PerfCounterId id);
+void perf_read(const PerfCounters* counters, PerfSample* sample);
+const char* perf_counter_name(PerfCounterId id);
+
+#endif // PERF_H
@@ -0,0 +1,203 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pool.h"
+
+// One worker's share of the current loop. The owner takes grain items at a time from the front and thieves split off
+// the back half; each range sits on its own cache line so owners and thieves of different ranges do not contend.
+typedef struct {
+    _Alignas(64) pthread_mutex_t lock;
+    size_t begin;
+    size_t end;
+} WorkRange;
+
+struct ThreadPool {
+    size_t n_threads;
+    pthread_t* threads;
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_done;
+    // Current job, published under lock by bumping generation
+    unsigned long generation;
+    bool shutdown;
+    PoolRangeFn fn;
+    void* ctx;
+    size_t grain;
+    WorkRange* ranges; // one per worker
+    size_t running;    // workers still inside the current job
+};
+
+typedef struct {
+    ThreadPool* pool;
+    size_t worker;
+} WorkerArgs;
+
+// Take up to grain items from the front of the worker's own range
+static bool take_own(ThreadPool* pool, size_t worker, size_t* begin, size_t* end) {
+    WorkRange* own = &pool->ranges[worker];
+    pthread_mutex_lock(&own->lock);
+    bool found = own->begin < own->end;
+    if (found) {
+        *begin     = own->begin;
+        *end       = own->end - own->begin > pool->grain ? own->begin + pool->grain : own->end;
+        own->begin = *end;
+    }
+    pthread_mutex_unlock(&own->lock);
+    return found;
+}
+
+// Move the back half of another worker's remaining range into this worker's (empty) one, trying the other workers
+// in turn. Fails once every range has run dry.
+static bool steal(ThreadPool* pool, size_t worker) {
+    for (size_t k = 1; k < pool->n_threads; k++) {
+        WorkRange* victim = &pool->ranges[(worker + k) % pool->n_threads];
+        pthread_mutex_lock(&victim->lock);
+        size_t end   = victim->end;
+        size_t begin = end - (end - victim->begin + 1) / 2;
+        victim->end  = begin;
+        pthread_mutex_unlock(&victim->lock);
+
+        if (begin < end) {
+            WorkRange* own = &pool->ranges[worker];
+            pthread_mutex_lock(&own->lock);
+            own->begin = begin;
+            own->end   = end;
+            pthread_mutex_unlock(&own->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void run_chunks(ThreadPool* pool, size_t worker) {
+    size_t begin;
+    size_t end;
+    for (;;) {
+        if (take_own(pool, worker, &begin, &end)) {
+            pool->fn(pool->ctx, begin, end, worker);
+        } else if (!steal(pool, worker)) {
+            break;
+        }
+    }
+}
+
+static void* worker_main(void* arg) {
+    WorkerArgs args = *(WorkerArgs*) arg;
+    free(arg);
+    ThreadPool* pool   = args.pool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->job_ready, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_chunks(pool, args.worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) {
+            pthread_cond_signal(&pool->job_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ThreadPool* pool_create(size_t n_threads) {
+    assert(n_threads > 0);
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    assert(pool && "Could not allocate thread pool");
+    pool->n_threads = n_threads;
+    pool->threads   = calloc(n_threads, sizeof(pthread_t));
+    assert(pool->threads && "Could not allocate thread pool");
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_ready, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+    pool->ranges = aligned_alloc(_Alignof(WorkRange), n_threads * sizeof(WorkRange));
+    assert(pool->ranges && "Could not allocate thread pool");
+    for (size_t i = 0; i < n_threads; i++) {
+        pthread_mutex_init(&pool->ranges[i].lock, NULL);
+        pool->ranges[i].begin = 0;
+        pool->ranges[i].end   = 0;
+    }
+
+    for (size_t i = 1; i < n_threads; i++) {
+        WorkerArgs* args = malloc(sizeof(WorkerArgs));
+        assert(args && "Could not allocate thread pool");
+        args->pool   = pool;
+        args->worker = i;
+        int rc       = pthread_create(&pool->threads[i], NULL, worker_main, args);
+        assert(rc == 0 && "Could not start worker thread");
+        (void) rc;
+    }
+    return pool;
+}
+
+void pool_destroy(ThreadPool* pool) {
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 1; i < pool->n_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->job_done);
+    pthread_cond_destroy(&pool->job_ready);
+    pthread_mutex_destroy(&pool->lock);
+    for (size_t i = 0; i < pool->n_threads; i++) {
+        pthread_mutex_destroy(&pool->ranges[i].lock);
+    }
+    free(pool->ranges);
+    free(pool->threads);
+    free(pool);
+}
+
+size_t pool_size(const ThreadPool* pool) { return pool ? pool->n_threads : 1; }
+
+void pool_for(ThreadPool* pool, size_t n, size_t grain, PoolRangeFn fn, void* ctx) {
+    if (n == 0) {
+        return;
+    }
+    if (!pool || pool->n_threads == 1 || n <= grain) {
+        fn(ctx, 0, n, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn    = fn;
+    pool->ctx   = ctx;
+    pool->grain = grain > 0 ? grain : 1;
+    // Every worker starts on an equal contiguous share; stealing evens out whatever the shares cost
+    for (size_t i = 0; i < pool->n_threads; i++) {
+        pool->ranges[i].begin = n * i / pool->n_threads;
+        pool->ranges[i].end   = n * (i + 1) / pool->n_threads;
+    }
+    pool->running = pool->n_threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_chunks(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->job_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+size_t pool_default_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t) n : 1;
+}
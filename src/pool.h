@@ -0,0 +1,26 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+// Fixed-size pool of worker threads for data-parallel loops. The calling thread takes part as worker 0, so a pool
+// of n threads starts n - 1 of its own.
+
+typedef struct ThreadPool ThreadPool;
+
+// Body of a parallel loop: handle items [begin, end) on behalf of worker (0 .. pool_size() - 1)
+typedef void (*PoolRangeFn)(void* ctx, size_t begin, size_t end, size_t worker);
+
+ThreadPool* pool_create(size_t n_threads);
+void pool_destroy(ThreadPool* pool);
+size_t pool_size(const ThreadPool* pool);
+
+// Run fn over [0, n) in chunks of at most grain items, and wait for all of them. Each worker starts on an equal
+// contiguous share of the range; a worker that runs out steals the back half of another's remainder, so skewed items
+// still keep every thread busy. A NULL pool runs the whole range on the calling thread.
+void pool_for(ThreadPool* pool, size_t n, size_t grain, PoolRangeFn fn, void* ctx);
+
+// Number of online CPUs, for --threads 0
+size_t pool_default_threads(void);
+
+#endif // POOL_H
@@ -0,0 +1,36 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+// USDT probes (provider "facc") for bpftrace, perf and SystemTap. With <sys/sdt.h> each probe is a single nop plus
+// an ELF note, so production builds keep them; without the header, or with -DFACC_NO_PROBES, they compile to nothing.
+//
+//   parse__start(path)                                  read_problem_data() entered
+//   parse__end(n_facilities, n_clients)                 instance loaded
+//   rank__start(n_costs)                                building the rank matrix
+//   rank__end(n_ranks)
+//   iteration__start(t, n_unassigned)                   greedy iteration t begins
+//   iteration__end(t, n_unassigned, facility, ratio_e6) facility ID opened, ratio in millionths (rounded)
+//   solve__end(iterations, n_unassigned)                greedy loop done
+//
+// e.g. bpftrace -e 'usdt:./bin/facc:facc:iteration__start { @s[tid] = nsecs; }
+//                   usdt:./bin/facc:facc:iteration__end /@s[tid]/ { @ns = hist(nsecs - @s[tid]); delete(@s[tid]); }'
+
+#if !defined(FACC_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define FACC_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef FACC_HAVE_PROBES
+#define FACC_PROBE1(name, a) DTRACE_PROBE1(facc, name, a)
+#define FACC_PROBE2(name, a, b) DTRACE_PROBE2(facc, name, a, b)
+#define FACC_PROBE4(name, a, b, c, d) DTRACE_PROBE4(facc, name, a, b, c, d)
+#else
+// Arguments are still evaluated (and then discarded) so they cannot go stale in builds without probes
+#define FACC_PROBE1(name, a) ((void) (a))
+#define FACC_PROBE2(name, a, b) ((void) (a), (void) (b))
+#define FACC_PROBE4(name, a, b, c, d) ((void) (a), (void) (b), (void) (c), (void) (d))
+#endif
+
+#endif // PROBES_H
@@ -0,0 +1,350 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rank.h"
+
+// RANK_SORT rows up to this long go through a sorting network, longer ones through a radix sort
+#define RANK_NETWORK_MAX 16
+// Side of the square tiles RANK_TRANSPOSED copies the sorted rows through
+#define RANK_TILE 32
+
+// Radix sort keys: unsigned integers in the same order as the costs. Adding zero first turns -0.0 into 0.0, which
+// compares equal to it and so must get the same key.
+static inline uint64_t cost_key_F64(double cost) {
+    uint64_t bits;
+    cost += 0.0;
+    memcpy(&bits, &cost, sizeof(bits));
+    return bits >> 63 ? ~bits : bits | (uint64_t) 1 << 63;
+}
+
+static inline uint32_t cost_key_F32(float cost) {
+    uint32_t bits;
+    cost += 0.0f;
+    memcpy(&bits, &cost, sizeof(bits));
+    return bits >> 31 ? ~bits : bits | (uint32_t) 1 << 31;
+}
+
+static inline uint32_t cost_key_I32(int32_t cost) { return (uint32_t) cost ^ (uint32_t) 1 << 31; }
+
+struct RankOps {
+    void (*fill_row)(RankMatrix* rm, const Data* data, size_t i);
+    void (*rank_row)(RankMatrix* rm, const Data* data, size_t i, void* scratch);
+    void (*transpose_rows)(RankMatrix* rm, const void* costs, const void* facilities, size_t n_ranks, size_t begin,
+                           size_t end);
+    FacilityClientPair (*rank_at)(RankMatrix* rm, size_t begin, size_t len, size_t client, size_t t);
+};
+
+#define RANK_COST double
+#define RANK_KEY uint64_t
+#define RANK_COST_KEY cost_key_F64
+#define RANK_INDEX uint32_t
+#define RANK_SUFFIX F64_U32
+#include "rank_impl.h"
+#undef RANK_COST
+#undef RANK_KEY
+#undef RANK_COST_KEY
+#undef RANK_INDEX
+#undef RANK_SUFFIX
+
+#define RANK_COST double
+#define RANK_KEY uint64_t
+#define RANK_COST_KEY cost_key_F64
+#define RANK_INDEX uint16_t
+#define RANK_SUFFIX F64_U16
+#include "rank_impl.h"
+#undef RANK_COST
+#undef RANK_KEY
+#undef RANK_COST_KEY
+#undef RANK_INDEX
+#undef RANK_SUFFIX
+
+#define RANK_COST float
+#define RANK_KEY uint32_t
+#define RANK_COST_KEY cost_key_F32
+#define RANK_INDEX uint32_t
+#define RANK_SUFFIX F32_U32
+#include "rank_impl.h"
+#undef RANK_COST
+#undef RANK_KEY
+#undef RANK_COST_KEY
+#undef RANK_INDEX
+#undef RANK_SUFFIX
+
+#define RANK_COST float
+#define RANK_KEY uint32_t
+#define RANK_COST_KEY cost_key_F32
+#define RANK_INDEX uint16_t
+#define RANK_SUFFIX F32_U16
+#include "rank_impl.h"
+#undef RANK_COST
+#undef RANK_KEY
+#undef RANK_COST_KEY
+#undef RANK_INDEX
+#undef RANK_SUFFIX
+
+#define RANK_COST int32_t
+#define RANK_KEY uint32_t
+#define RANK_COST_KEY cost_key_I32
+#define RANK_INDEX uint32_t
+#define RANK_SUFFIX I32_U32
+#include "rank_impl.h"
+#undef RANK_COST
+#undef RANK_KEY
+#undef RANK_COST_KEY
+#undef RANK_INDEX
+#undef RANK_SUFFIX
+
+#define RANK_COST int32_t
+#define RANK_KEY uint32_t
+#define RANK_COST_KEY cost_key_I32
+#define RANK_INDEX uint16_t
+#define RANK_SUFFIX I32_U16
+#include "rank_impl.h"
+#undef RANK_COST
+#undef RANK_KEY
+#undef RANK_COST_KEY
+#undef RANK_INDEX
+#undef RANK_SUFFIX
+
+typedef struct {
+    RankMatrix* rm;
+    const Data* data;
+    size_t* worker_ranks; // longest row seen by each worker
+    Trace* trace;         // optional
+} BuildRowsJob;
+
+// Fill and rank clients [begin, end). Rows are independent, so any split across workers gives the same matrix. A
+// chunk is filled completely before it is ranked, so the two show up as separate spans in a trace; a chunk is sized
+// to stay in cache between the two passes.
+static void build_rows(void* ctx, size_t begin_client, size_t end_client, size_t worker) {
+    BuildRowsJob* job = ctx;
+    RankMatrix* rm    = job->rm;
+    const Data* data  = job->data;
+    size_t n_ranks    = job->worker_ranks[worker];
+    double start      = job->trace ? monotonic_seconds() : 0;
+
+    for (size_t i = begin_client; i < end_client; i++) {
+        rm->ops->fill_row(rm, data, i);
+    }
+    double filled = job->trace ? monotonic_seconds() : 0;
+
+    // Radix sorts go through a buffer as long as the chunk's longest row
+    void* scratch = NULL;
+    if (rm->strategy != RANK_LAZY) {
+        size_t longest = 0;
+        for (size_t i = begin_client; i < end_client; i++) {
+            size_t len = row_begin(data, i + 1) - row_begin(data, i);
+            longest    = len > longest ? len : longest;
+        }
+        size_t entry = rank_cost_size(rm->cost_type) + rm->index_size;
+        scratch      = longest > RANK_NETWORK_MAX ? malloc(longest * entry) : NULL;
+        assert((scratch || longest <= RANK_NETWORK_MAX) && "Could not allocate sort buffer");
+    }
+
+    for (size_t i = begin_client; i < end_client; i++) {
+        rm->ops->rank_row(rm, data, i, scratch);
+        size_t len = row_begin(data, i + 1) - row_begin(data, i);
+        n_ranks    = len > n_ranks ? len : n_ranks;
+    }
+    free(scratch);
+    job->worker_ranks[worker] = n_ranks;
+
+    if (job->trace) {
+        trace_span(job->trace, worker, "fill rows", start, filled);
+        trace_span(job->trace, worker, rm->strategy == RANK_LAZY ? "heapify rows" : "sort rows", filled,
+                   monotonic_seconds());
+    }
+}
+
+typedef struct {
+    RankMatrix* rm;
+    const void* costs; // the sorted rows, row-major
+    const void* facilities;
+    Trace* trace; // optional
+} TransposeJob;
+
+static void transpose_clients(void* ctx, size_t begin_client, size_t end_client, size_t worker) {
+    TransposeJob* job = ctx;
+    double start      = job->trace ? monotonic_seconds() : 0;
+    job->rm->ops->transpose_rows(job->rm, job->costs, job->facilities, job->rm->n_ranks, begin_client, end_client);
+    if (job->trace) {
+        trace_span(job->trace, worker, "transpose rows", start, monotonic_seconds());
+    }
+}
+
+// RANK_TRANSPOSED: move the sorted rows into fresh rank-major arrays. Each worker writes the columns of its own
+// clients, so the result does not depend on the split.
+static void transpose(RankMatrix* rm, size_t n_clients, ThreadPool* pool, Trace* trace) {
+    size_t n_pairs   = n_clients * rm->n_ranks;
+    TransposeJob job = {.rm = rm, .costs = rm->costs, .facilities = rm->facilities, .trace = trace};
+    rm->stride       = n_clients;
+    rm->costs        = alloc_matrix(n_pairs, 1, rank_cost_size(rm->cost_type));
+    rm->facilities   = alloc_matrix(n_pairs, 1, rm->index_size);
+    assert(((rm->costs && rm->facilities) || n_pairs == 0) && "Could not allocate rank matrix");
+    pool_for(pool, n_clients, RANK_TILE, transpose_clients, &job);
+    free((void*) job.costs);
+    free((void*) job.facilities);
+}
+
+// Point instances: only the tree is built up front, every client starts with an empty cursor
+static void geo_build(RankMatrix* rm, const Data* data, Trace* trace) {
+    double start = trace ? monotonic_seconds() : 0;
+    geo_tree_build(&rm->tree, &data->geo, data->n_facilities);
+    rm->cursors = calloc(data->n_clients, sizeof(GeoCursor));
+    assert((rm->cursors || data->n_clients == 0) && "Could not allocate rank cursors");
+    rm->n_ranks = data->n_facilities;
+    if (trace) {
+        trace_span(trace, 0, "build k-d tree", start, monotonic_seconds());
+    }
+}
+
+static bool geo_rank_at(RankMatrix* rm, const Data* data, size_t client, size_t t, FacilityClientPair* ranked) {
+    GeoCursor* cursor = &rm->cursors[client];
+    assert(cursor->taken == t && "Point ranks must be consumed in order");
+    if (cursor->at == cursor->n_next) {
+        // Next batch: everything ranked after the last one handed out
+        const FacilityClientPair* last = cursor->n_next > 0 ? &cursor->next[cursor->n_next - 1] : NULL;
+        GeoNeighbor found[GEO_BATCH];
+        size_t n = geo_tree_next(&rm->tree, &data->geo, client, last ? last->cost : 0,
+                                 last ? last->facility : UINT32_MAX, found, GEO_BATCH);
+        for (size_t k = 0; k < n; k++) {
+            cursor->next[k] = (FacilityClientPair){.facility = found[k].facility, .cost = found[k].cost};
+        }
+        cursor->n_next = (uint32_t) n;
+        cursor->at     = 0;
+        if (n == 0) {
+            return false;
+        }
+    }
+    cursor->taken++;
+    *ranked = cursor->next[cursor->at++];
+    return true;
+}
+
+size_t rank_cost_size(CostType cost_type) {
+    switch (cost_type) {
+    case COST_F64:
+        return sizeof(double);
+    case COST_F32:
+        return sizeof(float);
+    case COST_I32:
+        return sizeof(int32_t);
+    case COST_AUTO:
+    default:
+        assert(false && "Unknown cost type");
+        return 0;
+    }
+}
+
+static const RankOps* rank_ops(CostType cost_type, size_t index_size) {
+    bool narrow = index_size == sizeof(uint16_t);
+    switch (cost_type) {
+    case COST_F64:
+        return narrow ? &ops_F64_U16 : &ops_F64_U32;
+    case COST_F32:
+        return narrow ? &ops_F32_U16 : &ops_F32_U32;
+    case COST_I32:
+        return narrow ? &ops_I32_U16 : &ops_I32_U32;
+    case COST_AUTO:
+    default:
+        assert(false && "Unknown cost type");
+        return NULL;
+    }
+}
+
+void rank_matrix_build(RankMatrix* rm, const Data* data, RankStrategy strategy, CostType cost_type, ThreadPool* pool,
+                       Trace* trace) {
+    size_t n_clients = data->n_clients;
+    size_t n_pairs   = row_begin(data, n_clients);
+
+    assert(data->n_facilities <= UINT32_MAX && "Too many facilities to rank");
+    // Ragged sparse rows have no rank-major form
+    rm->strategy   = strategy == RANK_TRANSPOSED && is_sparse(data) ? RANK_SORT : strategy;
+    rm->stride     = 0;
+    rm->cost_type  = cost_type == COST_AUTO ? data->cost_type : cost_type;
+    rm->index_size = data->n_facilities <= (size_t) UINT16_MAX + 1 ? sizeof(uint16_t) : sizeof(uint32_t);
+    rm->tree       = (GeoTree){0};
+    rm->cursors    = NULL;
+    rm->ops        = NULL;
+    if (is_geo(data)) {
+        rm->cost_type  = COST_F64;
+        rm->costs      = NULL;
+        rm->facilities = NULL;
+        rm->heap_len   = NULL;
+        geo_build(rm, data, trace);
+        return;
+    }
+    assert(cost_type_fits(data, rm->cost_type) && "Costs do not fit the requested cost type");
+    rm->ops        = rank_ops(rm->cost_type, rm->index_size);
+    rm->costs      = alloc_matrix(n_pairs, 1, rank_cost_size(rm->cost_type));
+    rm->facilities = alloc_matrix(n_pairs, 1, rm->index_size);
+    assert(((rm->costs && rm->facilities) || n_pairs == 0) && "Could not allocate rank matrix");
+    rm->heap_len = NULL;
+    if (strategy == RANK_LAZY) {
+        rm->heap_len = alloc_matrix(n_clients, 1, sizeof(size_t));
+        assert((rm->heap_len || n_clients == 0) && "Could not allocate rank heaps");
+    }
+
+    size_t n_workers = pool_size(pool);
+    BuildRowsJob job = {.rm = rm, .data = data, .worker_ranks = calloc(n_workers, sizeof(size_t)), .trace = trace};
+    assert(job.worker_ranks && "Could not allocate rank matrix");
+    // Chunks of about 64k entries keep scheduling overhead negligible while still balancing ragged sparse rows
+    size_t row_len = n_clients > 0 ? n_pairs / n_clients : 0;
+    size_t grain   = row_len > 0 ? 65536 / row_len + 1 : 1024;
+    pool_for(pool, n_clients, grain, build_rows, &job);
+
+    rm->n_ranks = 0;
+    for (size_t w = 0; w < n_workers; w++) {
+        rm->n_ranks = job.worker_ranks[w] > rm->n_ranks ? job.worker_ranks[w] : rm->n_ranks;
+    }
+    free(job.worker_ranks);
+    if (rm->strategy == RANK_TRANSPOSED) {
+        transpose(rm, n_clients, pool, trace);
+    }
+}
+
+void rank_matrix_free(RankMatrix* rm) {
+    free(rm->costs);
+    free(rm->facilities);
+    free(rm->heap_len);
+    free(rm->cursors);
+    geo_tree_free(&rm->tree);
+    rm->costs      = NULL;
+    rm->facilities = NULL;
+    rm->heap_len   = NULL;
+    rm->cursors    = NULL;
+}
+
+bool rank_matrix_at(RankMatrix* rm, const Data* data, size_t client, size_t t, FacilityClientPair* ranked) {
+    if (is_geo(data)) {
+        return t < data->n_facilities && geo_rank_at(rm, data, client, t, ranked);
+    }
+    size_t begin = row_begin(data, client);
+    size_t len   = row_begin(data, client + 1) - begin;
+    if (t >= len) {
+        return false;
+    }
+    *ranked = rm->ops->rank_at(rm, begin, len, client, t);
+    return true;
+}
+
+void rank_matrix_prefetch(const RankMatrix* rm, const Data* data, size_t client, size_t t) {
+    if (!rm->costs || t >= rm->n_ranks) {
+        return;
+    }
+    size_t at = row_begin(data, client); // a lazy row's next rank is its heap's root
+    switch (rm->strategy) {
+    case RANK_LAZY:
+        break;
+    case RANK_SORT:
+        at += t;
+        break;
+    case RANK_TRANSPOSED:
+        at = t * rm->stride + client;
+        break;
+    default:
+        assert(false && "Unknown rank strategy");
+    }
+    __builtin_prefetch((const char*) rm->costs + at * rank_cost_size(rm->cost_type));
+    __builtin_prefetch((const char*) rm->facilities + at * rm->index_size);
+}
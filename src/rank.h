@@ -0,0 +1,68 @@
+#ifndef RANK_H
+#define RANK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "facc.h"
+#include "pool.h"
+#include "trace.h"
+
+// Per-client ranking of facilities by connection cost, as read by the greedy loop in flp()
+
+// One rank of a client's row as handed to the greedy loop
+typedef struct {
+    uint32_t facility; // position in data->facilities: IDs are only looked up at the I/O boundary
+    double cost;
+} FacilityClientPair;
+
+// Point instances rank on demand: a client takes this many ranks from the k-d tree per query
+#define GEO_BATCH 16
+
+typedef struct {
+    FacilityClientPair next[GEO_BATCH]; // the client's upcoming ranks, nearest first
+    size_t taken;                       // ranks handed out so far
+    uint32_t n_next;
+    uint32_t at; // next[at] is rank taken
+} GeoCursor;
+
+// Row operations for one storage type (defined in rank.c)
+typedef struct RankOps RankOps;
+
+// Rows are stored as two parallel arrays, costs and facility positions, with the client implied by the row: 6 to 12
+// bytes per entry depending on the types. Narrower entries make the rows, and their sorting and popping, cheaper.
+typedef struct {
+    RankStrategy strategy;
+    CostType cost_type; // costs are double, float or int32_t
+    size_t index_size;  // facility positions are uint16_t (2, fewer than 65536 facilities) or uint32_t (4)
+    void* costs;        // row i starts at row_begin(data, i), like the cost store
+    void* facilities;   // position of the facility of each cost
+    size_t* heap_len;   // RANK_LAZY: entries of row i still in its heap (the front of the row)
+    size_t n_ranks;     // longest row: no client has a rank-t facility past this
+    size_t stride;      // RANK_TRANSPOSED: entries per rank, rank t of client i at t * stride + i
+    const RankOps* ops;
+    // Point instances store no rows (costs is NULL) whatever the strategy: ranks come from the tree
+    GeoTree tree;
+    GeoCursor* cursors; // per client
+} RankMatrix;
+
+// Bytes per stored cost
+size_t rank_cost_size(CostType cost_type);
+
+// Fill and rank every row, spread over pool's workers (NULL: on the calling thread). Costs are stored as cost_type
+// (COST_AUTO: data->cost_type), which must hold all of them exactly. RANK_TRANSPOSED falls back to RANK_SORT for
+// sparse instances. The result does not depend on the number of workers or the cost type. With a trace, every chunk
+// adds its fill, rank and transpose spans on its worker's lane.
+void rank_matrix_build(RankMatrix* rm, const Data* data, RankStrategy strategy, CostType cost_type, ThreadPool* pool,
+                       Trace* trace);
+void rank_matrix_free(RankMatrix* rm);
+
+// Entry of rank t in client's row into *ranked, or false if the row is shorter than that. With RANK_LAZY, and for
+// point instances, the rows are consumed in order: a client must ask for t = 0, 1, 2, ... once each, which is how the
+// greedy loop visits unassigned clients.
+bool rank_matrix_at(RankMatrix* rm, const Data* data, size_t client, size_t t, FacilityClientPair* ranked);
+
+// Start loading the memory rank_matrix_at() will read for client's rank t
+void rank_matrix_prefetch(const RankMatrix* rm, const Data* data, size_t client, size_t t);
+
+#endif // RANK_H
@@ -0,0 +1,241 @@
+// Rank rows of one storage type. rank.c includes this once per cost and facility index type, with RANK_COST (the
+// stored cost type), RANK_KEY and RANK_COST_KEY (the unsigned sort key type and its function, see cost_key_F64),
+// RANK_INDEX (uint16_t or uint32_t facility positions) and RANK_SUFFIX (F64_U32, I32_U16, ...) defined; every
+// function gets the suffix, e.g. heapify_I32_U16.
+
+#define RANK_CAT_(a, b) a##b
+#define RANK_CAT(a, b) RANK_CAT_(a, b)
+#define RANK_NAME(name) RANK_CAT(name##_, RANK_SUFFIX)
+#define RANK_ROW RANK_CAT(RankRow, RANK_SUFFIX)
+
+// A row, or the part of one from some entry on: its costs and their facility positions, as two parallel arrays
+typedef struct {
+    RANK_COST* cost;
+    RANK_INDEX* facility;
+} RANK_ROW;
+
+static inline RANK_ROW RANK_NAME(row_at)(const RankMatrix* rm, size_t begin) {
+    return (RANK_ROW){.cost = (RANK_COST*) rm->costs + begin, .facility = (RANK_INDEX*) rm->facilities + begin};
+}
+
+// Order by cost, then facility position, so every strategy and every storage type ranks ties the same way
+static inline bool RANK_NAME(ranks_before)(RANK_COST cost_a, RANK_INDEX facility_a, RANK_COST cost_b,
+                                           RANK_INDEX facility_b) {
+    return cost_a < cost_b || (!(cost_b < cost_a) && facility_a < facility_b);
+}
+
+static inline bool RANK_NAME(entry_before)(RANK_ROW row, size_t a, size_t b) {
+    return RANK_NAME(ranks_before)(row.cost[a], row.facility[a], row.cost[b], row.facility[b]);
+}
+
+static void RANK_NAME(sift_down)(RANK_ROW heap, size_t len, size_t i) {
+    RANK_COST cost      = heap.cost[i];
+    RANK_INDEX facility = heap.facility[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= len) {
+            break;
+        }
+        if (child + 1 < len && RANK_NAME(entry_before)(heap, child + 1, child)) {
+            child++;
+        }
+        if (!RANK_NAME(ranks_before)(heap.cost[child], heap.facility[child], cost, facility)) {
+            break;
+        }
+        heap.cost[i]     = heap.cost[child];
+        heap.facility[i] = heap.facility[child];
+        i                = child;
+    }
+    heap.cost[i]     = cost;
+    heap.facility[i] = facility;
+}
+
+static void RANK_NAME(heapify)(RANK_ROW heap, size_t len) {
+    for (size_t i = len / 2; i-- > 0;) {
+        RANK_NAME(sift_down)(heap, len, i);
+    }
+}
+
+// Move the cheapest entry out of the heap into the slot just past it, so the popped ranks collect at the back of
+// the row (in reverse)
+static FacilityClientPair RANK_NAME(heap_pop)(RANK_ROW heap, size_t* len) {
+    assert(*len > 0);
+    RANK_COST cost      = heap.cost[0];
+    RANK_INDEX facility = heap.facility[0];
+    (*len)--;
+    heap.cost[0]        = heap.cost[*len];
+    heap.facility[0]    = heap.facility[*len];
+    heap.cost[*len]     = cost;
+    heap.facility[*len] = facility;
+    RANK_NAME(sift_down)(heap, *len, 0);
+    return (FacilityClientPair){.facility = facility, .cost = (double) cost};
+}
+
+static inline void RANK_NAME(compare_exchange)(RANK_ROW row, size_t i, size_t j) {
+    RANK_COST cost_i      = row.cost[i];
+    RANK_COST cost_j      = row.cost[j];
+    RANK_INDEX facility_i = row.facility[i];
+    RANK_INDEX facility_j = row.facility[j];
+    bool swap             = RANK_NAME(ranks_before)(cost_j, facility_j, cost_i, facility_i);
+    row.cost[i]           = swap ? cost_j : cost_i;
+    row.cost[j]           = swap ? cost_i : cost_j;
+    row.facility[i]       = swap ? facility_j : facility_i;
+    row.facility[j]       = swap ? facility_i : facility_j;
+}
+
+// Batcher's merge exchange (Knuth, TAOCP 5.2.2, algorithm M), a sorting network for any length: the same
+// comparisons run whatever the costs are
+static void RANK_NAME(sort_network)(RANK_ROW row, size_t len) {
+    size_t top = 1;
+    while (top * 2 < len) {
+        top *= 2;
+    }
+    for (size_t p = top; p > 0 && len > 1; p /= 2) {
+        size_t q = top;
+        size_t r = 0;
+        size_t d = p;
+        for (;;) {
+            for (size_t i = 0; i + d < len; i++) {
+                if ((i & p) == r) {
+                    RANK_NAME(compare_exchange)(row, i, i + d);
+                }
+            }
+            if (q == p) {
+                break;
+            }
+            d = q - p;
+            q /= 2;
+            r = p;
+        }
+    }
+}
+
+// LSD radix sort on the cost keys, one byte per pass, through scratch (len entries). It is stable and rows are
+// filled in facility order, so ties keep ranking by facility position. Bytes that every key shares are skipped,
+// which leaves one or two passes for small integer costs.
+static void RANK_NAME(radix_sort)(RANK_ROW row, RANK_ROW scratch, size_t len) {
+    size_t counts[sizeof(RANK_KEY)][256];
+    memset(counts, 0, sizeof(counts));
+    for (size_t k = 0; k < len; k++) {
+        RANK_KEY key = RANK_COST_KEY(row.cost[k]);
+        for (size_t pass = 0; pass < sizeof(RANK_KEY); pass++) {
+            counts[pass][(size_t) (key >> (8 * pass)) & 0xff]++;
+        }
+    }
+
+    RANK_ROW from = row;
+    RANK_ROW to   = scratch;
+    for (size_t pass = 0; pass < sizeof(RANK_KEY); pass++) {
+        size_t* count = counts[pass];
+        size_t shift  = 8 * pass;
+        if (count[(size_t) (RANK_COST_KEY(from.cost[0]) >> shift) & 0xff] == len) {
+            continue;
+        }
+        size_t offset = 0;
+        for (size_t b = 0; b < 256; b++) {
+            size_t n = count[b];
+            count[b] = offset;
+            offset += n;
+        }
+        for (size_t k = 0; k < len; k++) {
+            size_t b        = (size_t) (RANK_COST_KEY(from.cost[k]) >> shift) & 0xff;
+            size_t at       = count[b]++;
+            to.cost[at]     = from.cost[k];
+            to.facility[at] = from.facility[k];
+        }
+        RANK_ROW swap = from;
+        from          = to;
+        to            = swap;
+    }
+    if (from.cost != row.cost) {
+        memcpy(row.cost, from.cost, len * sizeof(RANK_COST));
+        memcpy(row.facility, from.facility, len * sizeof(RANK_INDEX));
+    }
+}
+
+// Copy row i out of the cost store; rank_matrix_build() has checked that every cost converts exactly and that every
+// facility position fits RANK_INDEX
+static void RANK_NAME(fill_row)(RankMatrix* rm, const Data* data, size_t i) {
+    size_t begin  = row_begin(data, i);
+    size_t len    = row_begin(data, i + 1) - begin;
+    RANK_ROW rank = RANK_NAME(row_at)(rm, begin);
+    for (size_t k = 0; k < len; k++) {
+        rank.facility[k] = (RANK_INDEX) entry_facility(data, begin, begin + k);
+        rank.cost[k]     = (RANK_COST) data->connection_costs[begin + k];
+    }
+}
+
+// scratch holds at least the row's length in entries, costs and facilities (RANK_SORT only)
+static void RANK_NAME(rank_row)(RankMatrix* rm, const Data* data, size_t i, void* scratch) {
+    size_t begin  = row_begin(data, i);
+    size_t len    = row_begin(data, i + 1) - begin;
+    RANK_ROW rank = RANK_NAME(row_at)(rm, begin);
+    switch (rm->strategy) {
+    case RANK_LAZY:
+        RANK_NAME(heapify)(rank, len);
+        rm->heap_len[i] = len;
+        break;
+    case RANK_SORT:
+    case RANK_TRANSPOSED:
+        if (len <= RANK_NETWORK_MAX) {
+            RANK_NAME(sort_network)(rank, len);
+        } else {
+            RANK_ROW buffer = {.cost = scratch, .facility = (RANK_INDEX*) ((RANK_COST*) scratch + len)};
+            RANK_NAME(radix_sort)(rank, buffer, len);
+        }
+        break;
+    default:
+        assert(false && "Unknown rank strategy");
+    }
+}
+
+// Rows [begin, end) of the sorted row-major matrix at costs and facilities (n_ranks entries per row) into rm,
+// rank-major. Tiles of RANK_TILE x RANK_TILE entries keep both the rows read and the ranks written in cache.
+static void RANK_NAME(transpose_rows)(RankMatrix* rm, const void* costs, const void* facilities, size_t n_ranks,
+                                      size_t begin, size_t end) {
+    const RANK_COST* from_cost      = costs;
+    const RANK_INDEX* from_facility = facilities;
+    RANK_ROW to                     = RANK_NAME(row_at)(rm, 0);
+    size_t stride                   = rm->stride;
+    for (size_t i0 = begin; i0 < end; i0 += RANK_TILE) {
+        size_t i1 = i0 + RANK_TILE < end ? i0 + RANK_TILE : end;
+        for (size_t t0 = 0; t0 < n_ranks; t0 += RANK_TILE) {
+            size_t t1 = t0 + RANK_TILE < n_ranks ? t0 + RANK_TILE : n_ranks;
+            for (size_t t = t0; t < t1; t++) {
+                for (size_t i = i0; i < i1; i++) {
+                    to.cost[t * stride + i]     = from_cost[i * n_ranks + t];
+                    to.facility[t * stride + i] = from_facility[i * n_ranks + t];
+                }
+            }
+        }
+    }
+}
+
+// Rank t of the row [begin, begin + len) of client, t < len
+static FacilityClientPair RANK_NAME(rank_at)(RankMatrix* rm, size_t begin, size_t len, size_t client, size_t t) {
+    size_t at = begin + t;
+    switch (rm->strategy) {
+    case RANK_LAZY:
+        assert(len - rm->heap_len[client] == t && "Lazy ranks must be consumed in order");
+        return RANK_NAME(heap_pop)(RANK_NAME(row_at)(rm, begin), &rm->heap_len[client]);
+    case RANK_SORT:
+        break;
+    case RANK_TRANSPOSED:
+        at = t * rm->stride + client;
+        break;
+    default:
+        assert(false && "Unknown rank strategy");
+    }
+    RANK_ROW rank = RANK_NAME(row_at)(rm, at);
+    return (FacilityClientPair){.facility = rank.facility[0], .cost = (double) rank.cost[0]};
+}
+
+static const RankOps RANK_NAME(ops) = {.fill_row       = RANK_NAME(fill_row),
+                                       .rank_row       = RANK_NAME(rank_row),
+                                       .transpose_rows = RANK_NAME(transpose_rows),
+                                       .rank_at        = RANK_NAME(rank_at)};
+
+#undef RANK_ROW
+#undef RANK_NAME
+#undef RANK_CAT
+#undef RANK_CAT_
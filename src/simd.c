@@ -0,0 +1,225 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "simd.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SIMD_X86 1
+#include <immintrin.h>
+_Static_assert(sizeof(size_t) == sizeof(int64_t), "counts are compared as 64-bit lanes");
+#endif
+
+// Fixed pairwise reduction of the SIMD_LANES accumulators. The vector paths fold the upper half onto the lower half
+// first, which is exactly this tree.
+static double reduce_lanes(const double acc[SIMD_LANES]) {
+    return ((acc[0] + acc[4]) + (acc[2] + acc[6])) + ((acc[1] + acc[5]) + (acc[3] + acc[7]));
+}
+
+// Shared tail of every sum: the last n % SIMD_LANES elements go into the leading lanes
+static double finish_sum(double acc[SIMD_LANES], const double* x, size_t n) {
+    for (size_t j = 0; j < n; j++) {
+        acc[j] += x[j];
+    }
+    return reduce_lanes(acc);
+}
+
+static double sum_scalar(const double* x, size_t n) {
+    double acc[SIMD_LANES] = {0};
+    size_t i               = 0;
+    for (; i + SIMD_LANES <= n; i += SIMD_LANES) {
+        for (size_t j = 0; j < SIMD_LANES; j++) {
+            acc[j] += x[i + j];
+        }
+    }
+    return finish_sum(acc, x + i, n - i);
+}
+
+static size_t argmin_scalar(const double* ratio, const size_t* count, size_t n) {
+    double best_ratio = INFINITY;
+    size_t best_count = 0;
+    size_t best       = SIZE_MAX;
+    for (size_t i = 0; i < n; i++) {
+        if (count[i] == 0) {
+            continue;
+        }
+        bool tied = !(ratio[i] < best_ratio) && !(ratio[i] > best_ratio) && !isnan(ratio[i]);
+        if (ratio[i] < best_ratio || (tied && count[i] > best_count)) {
+            best_ratio = ratio[i];
+            best_count = count[i];
+            best       = i;
+        }
+    }
+    return best;
+}
+
+#ifdef SIMD_X86
+// The vector argmins work in three passes: the smallest valid ratio, the largest count among entries at that ratio,
+// then the first index holding both. Only the last pass can stop early.
+
+__attribute__((target("avx2"))) static double sum_avx2(const double* x, size_t n) {
+    __m256d lo = _mm256_setzero_pd();
+    __m256d hi = _mm256_setzero_pd();
+    size_t i   = 0;
+    for (; i + SIMD_LANES <= n; i += SIMD_LANES) {
+        lo = _mm256_add_pd(lo, _mm256_loadu_pd(x + i));
+        hi = _mm256_add_pd(hi, _mm256_loadu_pd(x + i + 4));
+    }
+    double acc[SIMD_LANES];
+    _mm256_storeu_pd(acc, lo);
+    _mm256_storeu_pd(acc + 4, hi);
+    return finish_sum(acc, x + i, n - i);
+}
+
+__attribute__((target("avx2"))) static size_t argmin_avx2(const double* ratio, const size_t* count, size_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256d inf  = _mm256_set1_pd(INFINITY);
+
+    // Pass 1: invalid entries become +inf; a NaN in the first operand of min_pd yields the second, so NaNs drop out
+    __m256d vmin = inf;
+    size_t i     = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d r       = _mm256_loadu_pd(ratio + i);
+        __m256i c       = _mm256_loadu_si256((const __m256i*) (count + i));
+        __m256d invalid = _mm256_castsi256_pd(_mm256_cmpeq_epi64(c, zero));
+        vmin            = _mm256_min_pd(_mm256_blendv_pd(r, inf, invalid), vmin);
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, vmin);
+    double best_ratio = fmin(fmin(lanes[0], lanes[1]), fmin(lanes[2], lanes[3]));
+    for (size_t k = i; k < n; k++) {
+        if (count[k] > 0 && ratio[k] < best_ratio) {
+            best_ratio = ratio[k];
+        }
+    }
+
+    // Pass 2: counts of entries away from the minimum are masked to zero, which invalid entries already are
+    const __m256d m = _mm256_set1_pd(best_ratio);
+    __m256i vmax    = zero;
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256i at = _mm256_castpd_si256(_mm256_cmp_pd(_mm256_loadu_pd(ratio + i), m, _CMP_EQ_OQ));
+        __m256i c  = _mm256_and_si256(at, _mm256_loadu_si256((const __m256i*) (count + i)));
+        __m256i gt = _mm256_cmpgt_epi64(c, vmax);
+        vmax       = _mm256_blendv_epi8(vmax, c, gt);
+    }
+    size_t counts[4];
+    _mm256_storeu_si256((__m256i*) counts, vmax);
+    size_t best_count = 0;
+    for (size_t k = 0; k < 4; k++) {
+        best_count = counts[k] > best_count ? counts[k] : best_count;
+    }
+    for (size_t k = i; k < n; k++) {
+        bool at = !(ratio[k] < best_ratio) && !(ratio[k] > best_ratio) && !isnan(ratio[k]);
+        if (at && count[k] > best_count) {
+            best_count = count[k];
+        }
+    }
+    if (best_count == 0) {
+        return SIZE_MAX;
+    }
+
+    // Pass 3
+    const __m256i want = _mm256_set1_epi64x((long long) best_count);
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256i at    = _mm256_castpd_si256(_mm256_cmp_pd(_mm256_loadu_pd(ratio + i), m, _CMP_EQ_OQ));
+        __m256i c     = _mm256_loadu_si256((const __m256i*) (count + i));
+        __m256i hit   = _mm256_and_si256(at, _mm256_cmpeq_epi64(c, want));
+        unsigned bits = (unsigned) _mm256_movemask_pd(_mm256_castsi256_pd(hit));
+        if (bits) {
+            return i + (size_t) __builtin_ctz(bits);
+        }
+    }
+    for (; i < n; i++) {
+        if (count[i] == best_count && !(ratio[i] < best_ratio) && !(ratio[i] > best_ratio) && !isnan(ratio[i])) {
+            return i;
+        }
+    }
+    return SIZE_MAX; // unreachable: pass 2 saw the entry
+}
+
+__attribute__((target("avx512f"))) static double sum_avx512(const double* x, size_t n) {
+    __m512d acc = _mm512_setzero_pd();
+    size_t i    = 0;
+    for (; i + SIMD_LANES <= n; i += SIMD_LANES) {
+        acc = _mm512_add_pd(acc, _mm512_loadu_pd(x + i));
+    }
+    double lanes[SIMD_LANES];
+    _mm512_storeu_pd(lanes, acc);
+    return finish_sum(lanes, x + i, n - i);
+}
+
+__attribute__((target("avx512f"))) static size_t argmin_avx512(const double* ratio, const size_t* count, size_t n) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512d inf  = _mm512_set1_pd(INFINITY);
+    const size_t full  = n - n % 8;
+
+    // Pass 1: the tail is a masked load, with the lanes past n treated as invalid
+    __m512d vmin = inf;
+    for (size_t i = 0; i < n; i += 8) {
+        __mmask8 lanes = i < full ? (__mmask8) 0xFF : (__mmask8) ((1u << (n - i)) - 1);
+        __m512d r      = _mm512_mask_loadu_pd(inf, lanes, ratio + i);
+        __m512i c      = _mm512_maskz_loadu_epi64(lanes, count + i);
+        __mmask8 valid = _mm512_cmpneq_epi64_mask(c, zero) & _mm512_cmp_pd_mask(r, r, _CMP_ORD_Q);
+        vmin           = _mm512_mask_min_pd(vmin, valid, r, vmin);
+    }
+    double best_ratio = _mm512_reduce_min_pd(vmin);
+
+    // Pass 2
+    const __m512d m = _mm512_set1_pd(best_ratio);
+    __m512i vmax    = zero;
+    for (size_t i = 0; i < n; i += 8) {
+        __mmask8 lanes = i < full ? (__mmask8) 0xFF : (__mmask8) ((1u << (n - i)) - 1);
+        __mmask8 at    = _mm512_mask_cmp_pd_mask(lanes, _mm512_maskz_loadu_pd(lanes, ratio + i), m, _CMP_EQ_OQ);
+        vmax           = _mm512_max_epu64(vmax, _mm512_maskz_loadu_epi64(at, count + i));
+    }
+    size_t best_count = (size_t) _mm512_reduce_max_epu64(vmax);
+    if (best_count == 0) {
+        return SIZE_MAX;
+    }
+
+    // Pass 3
+    const __m512i want = _mm512_set1_epi64((long long) best_count);
+    for (size_t i = 0; i < n; i += 8) {
+        __mmask8 lanes = i < full ? (__mmask8) 0xFF : (__mmask8) ((1u << (n - i)) - 1);
+        __mmask8 at    = _mm512_mask_cmp_pd_mask(lanes, _mm512_maskz_loadu_pd(lanes, ratio + i), m, _CMP_EQ_OQ);
+        __mmask8 hit   = _mm512_mask_cmpeq_epi64_mask(at, _mm512_maskz_loadu_epi64(lanes, count + i), want);
+        if (hit) {
+            return i + (size_t) __builtin_ctz(hit);
+        }
+    }
+    return SIZE_MAX; // unreachable: pass 2 saw the entry
+}
+#endif // SIMD_X86
+
+static const SimdKernels kernels_scalar = {SIMD_SCALAR, "scalar", sum_scalar, argmin_scalar};
+#ifdef SIMD_X86
+static const SimdKernels kernels_avx2   = {SIMD_AVX2, "avx2", sum_avx2, argmin_avx2};
+static const SimdKernels kernels_avx512 = {SIMD_AVX512, "avx512", sum_avx512, argmin_avx512};
+#endif
+
+const SimdKernels* simd_kernels(SimdLevel level) {
+    switch (level) {
+    case SIMD_AUTO: {
+        const SimdKernels* best = simd_kernels(SIMD_AVX512);
+        if (!best) {
+            best = simd_kernels(SIMD_AVX2);
+        }
+        return best ? best : &kernels_scalar;
+    }
+    case SIMD_SCALAR:
+        return &kernels_scalar;
+    case SIMD_AVX2:
+#ifdef SIMD_X86
+        return __builtin_cpu_supports("avx2") ? &kernels_avx2 : NULL;
+#else
+        return NULL;
+#endif
+    case SIMD_AVX512:
+#ifdef SIMD_X86
+        return __builtin_cpu_supports("avx512f") ? &kernels_avx512 : NULL;
+#else
+        return NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stddef.h>
+
+// Vector kernels for the per-iteration loops of flp(), with a scalar fallback and AVX2/AVX-512 versions picked at
+// runtime. Every version returns bit-identical results: sums are always accumulated in SIMD_LANES interleaved lanes
+// and reduced in the same fixed order, whatever the vector width.
+
+#define SIMD_LANES 8
+
+typedef enum {
+    SIMD_AUTO, // widest level the CPU supports
+    SIMD_SCALAR,
+    SIMD_AVX2,
+    SIMD_AVX512,
+} SimdLevel;
+
+typedef struct {
+    SimdLevel level;
+    const char* name;
+    // Sum of x[0 .. n) in the canonical lane order
+    double (*sum)(const double* x, size_t n);
+    // Index of the smallest ratio among entries with count > 0, ties going to the larger count and then to the lower
+    // index. NaN ratios never win. SIZE_MAX if no entry qualifies.
+    size_t (*argmin)(const double* ratio, const size_t* count, size_t n);
+} SimdKernels;
+
+// Kernels for level, or NULL if this CPU (or build) cannot run them. SIMD_AUTO never returns NULL.
+const SimdKernels* simd_kernels(SimdLevel level);
+
+#endif // SIMD_H
@@ -0,0 +1,105 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include "arena.h"
+#include "facc.h"
+#include "trace.h"
+
+void trace_init(Trace* trace) {
+    trace->origin = monotonic_seconds();
+    trace->lanes  = NULL;
+    trace_reserve_lanes(trace, 1);
+}
+
+void trace_free(Trace* trace) {
+    for (size_t i = 0; i < arrlenu(trace->lanes); i++) {
+        arrfree(trace->lanes[i]);
+    }
+    arrfree(trace->lanes);
+}
+
+void trace_reserve_lanes(Trace* trace, size_t n) {
+    while (arrlenu(trace->lanes) < n) {
+        arrpush(trace->lanes, NULL);
+    }
+}
+
+TraceEvent* trace_span(Trace* trace, size_t lane, const char* name, double begin, double end) {
+    assert(lane < arrlenu(trace->lanes) && "Trace lane not reserved");
+    TraceEvent event = {.name = name, .begin = begin, .end = end, .n_args = 0};
+    arrpush(trace->lanes[lane], event);
+    return &arrlast(trace->lanes[lane]);
+}
+
+void trace_arg(TraceEvent* event, const char* name, double value) {
+    assert(event->n_args < TRACE_MAX_ARGS && "Too many trace arguments");
+    event->arg_names[event->n_args]  = name;
+    event->arg_values[event->n_args] = value;
+    event->n_args++;
+}
+
+void trace_extent_add(TraceExtent* extent, double begin, double end) {
+    if (extent->begin <= 0) {
+        extent->begin = begin;
+    }
+    extent->end = end;
+}
+
+void trace_extents_flush(Trace* trace, const char* name, TraceExtent* extents, size_t n_workers) {
+    for (size_t w = 0; w < n_workers; w++) {
+        if (extents[w].begin > 0) {
+            trace_span(trace, w, name, extents[w].begin, extents[w].end);
+        }
+        extents[w].begin = 0;
+        extents[w].end   = 0;
+    }
+}
+
+bool trace_write(const Trace* trace, const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Error: Cannot open file %s\n", path);
+        return false;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (size_t lane = 0; lane < arrlenu(trace->lanes); lane++) {
+        fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, \"args\": {\"name\": ",
+                lane > 0 ? ",\n" : "", lane);
+        if (lane == 0) {
+            fprintf(f, "\"main\"}}");
+        } else {
+            fprintf(f, "\"worker %zu\"}}", lane);
+        }
+    }
+    for (size_t lane = 0; lane < arrlenu(trace->lanes); lane++) {
+        for (size_t i = 0; i < arrlenu(trace->lanes[lane]); i++) {
+            const TraceEvent* e = &trace->lanes[lane][i];
+            // Microseconds, as the format expects
+            fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"facc\", \"ph\": \"X\", \"pid\": 1, \"tid\": %zu, ", e->name,
+                    lane);
+            fprintf(f, "\"ts\": %.3f, \"dur\": %.3f", (e->begin - trace->origin) * 1e6, (e->end - e->begin) * 1e6);
+            if (e->n_args > 0) {
+                fprintf(f, ", \"args\": {");
+                for (size_t a = 0; a < e->n_args; a++) {
+                    fprintf(f, "%s\"%s\": ", a > 0 ? ", " : "", e->arg_names[a]);
+                    if (isfinite(e->arg_values[a])) {
+                        fprintf(f, "%.17g", e->arg_values[a]);
+                    } else {
+                        fprintf(f, "null"); // JSON has no infinities
+                    }
+                }
+                fprintf(f, "}");
+            }
+            fprintf(f, "}");
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    bool ok = !ferror(f);
+    ok      = fclose(f) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write %s\n", path);
+    }
+    return ok;
+}
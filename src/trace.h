@@ -0,0 +1,46 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Timeline of a solve as Chrome trace events (chrome://tracing, ui.perfetto.dev). Spans are recorded on lanes: lane 0
+// is the calling thread and lane w is pool worker w, so parallel phases show one row per thread. Each lane is only
+// ever appended to by its own thread, so recording takes no locks.
+
+#define TRACE_MAX_ARGS 3
+
+typedef struct {
+    const char* name; // static string
+    double begin;     // monotonic_seconds()
+    double end;
+    size_t n_args;
+    const char* arg_names[TRACE_MAX_ARGS];
+    double arg_values[TRACE_MAX_ARGS];
+} TraceEvent;
+
+typedef struct {
+    double origin;       // timestamps are written relative to this
+    TraceEvent** lanes;  // stb_ds array of stb_ds arrays
+} Trace;
+
+// First chunk start to last chunk end of one worker inside one parallel loop; begin is 0 until it runs a chunk
+typedef struct {
+    double begin;
+    double end;
+} TraceExtent;
+
+void trace_init(Trace* trace);
+void trace_free(Trace* trace);
+// Make sure lanes 0 .. n - 1 exist. Call from the calling thread while no workers are recording.
+void trace_reserve_lanes(Trace* trace, size_t n);
+TraceEvent* trace_span(Trace* trace, size_t lane, const char* name, double begin, double end);
+void trace_arg(TraceEvent* event, const char* name, double value);
+
+void trace_extent_add(TraceExtent* extent, double begin, double end);
+// One span per worker that took part, then reset the extents for the next loop
+void trace_extents_flush(Trace* trace, const char* name, TraceExtent* extents, size_t n_workers);
+
+bool trace_write(const Trace* trace, const char* path);
+
+#endif // TRACE_H
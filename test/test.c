@@ -6,6 +6,15 @@
 // Define TEST_BUILD before including main.c to exclude main()
 #define TEST_BUILD
 #include "facc.c"
+#include "faccb.c"
+#include "arena.c"
+#include "pool.c"
+#include "rank.c"
+#include "simd.c"
+#include "gen.c"
+#include "geo.c"
+#include "perf.c"
+#include "trace.c"
 
 int tests_run = 0;
 
@@ -31,8 +40,694 @@ static char* test_example(void) {
     return 0;
 }
 
+// Rows far past the old 1024-character line buffer must parse intact
+static char* test_long_rows(void) {
+    const size_t n_f = 600;
+    char* text       = NULL;
+    char number[32];
+    for (int line = 0; line < 4; line++) {
+        for (size_t i = 0; i < n_f; i++) {
+            int len = snprintf(number, sizeof(number), "%zu ", line == 2 ? (size_t) 1 : i + 1);
+            for (int k = 0; k < len; k++) {
+                arrpush(text, number[k]);
+            }
+            if (line == 2) {
+                break; // single client
+            }
+        }
+        arrpush(text, '\n');
+    }
+
+    Data data = {0};
+    init_data(&data);
+    parse_problem_text(text, arrlenu(text), &data);
+    mu_assert("error, n_facilities != 600", data.n_facilities == n_f);
+    mu_assert("error, n_clients != 1", data.n_clients == 1);
+    mu_assert("error, last facility id", data.facilities[n_f - 1] == 600);
+    mu_assert("error, last opening cost", (int) opening_cost(&data, n_f - 1) == 600);
+    mu_assert("error, last connection cost", (int) connection_cost(&data, 0, n_f - 1) == 600);
+    free_data(&data);
+    arrfree(text);
+
+    return 0;
+}
+
+// A .faccb round trip must load the same instance and produce the same solution
+static char* test_binary_roundtrip(void) {
+    const char* path = "build/test/example.faccb";
+    Data text        = {0};
+    init_data(&text);
+    read_problem_data("example.txt", &text);
+    mu_assert("error, could not write .faccb", write_problem_binary(&text, path));
+
+    Data data = {0};
+    init_data(&data);
+    mu_assert("error, could not read .faccb", read_problem_data((char*) path, &data));
+    mu_assert("error, binary input should stay mapped", data.mapping.data != NULL);
+    mu_assert("error, n_facilities mismatch", data.n_facilities == text.n_facilities);
+    mu_assert("error, n_clients mismatch", data.n_clients == text.n_clients);
+    mu_assert("error, client ids mismatch", memcmp(data.clients, text.clients, text.n_clients * sizeof(int)) == 0);
+    mu_assert("error, cost matrix mismatch", memcmp(data.connection_costs, text.connection_costs,
+                                                    text.n_clients * text.n_facilities * sizeof(double)) == 0);
+
+    mu_assert("error, cost type lost", data.cost_type == COST_I32);
+
+    Assignment* M     = NULL;
+    double total_cost = flp(&data, &M);
+    mu_assert("error, cost != 38", (int) total_cost == 38);
+    mu_assert("Facility 4 - 0 assigned to 3", M[3].clients[0] == 3);
+    free_assignments(&data, M);
+    free_data(&data);
+
+    // The cost type comes from the header, not from the costs: rewrite it and the loader follows
+    uint32_t f64 = COST_F64;
+    FILE* fp     = fopen(path, "r+b");
+    mu_assert("error, could not reopen .faccb", fp != NULL);
+    fseek(fp, (long) offsetof(FaccbHeader, cost_type), SEEK_SET);
+    fwrite(&f64, sizeof(f64), 1, fp);
+    fclose(fp);
+    init_data(&data);
+    mu_assert("error, could not read patched .faccb", read_problem_data((char*) path, &data));
+    mu_assert("error, cost type should be read from the header", data.cost_type == COST_F64);
+    free_data(&data);
+
+    // A header that claims narrower costs than the file holds is rejected
+    uint32_t i32             = COST_I32;
+    text.connection_costs[0] = 0.5;
+    text.cost_type           = COST_F64;
+    mu_assert("error, could not rewrite .faccb", write_problem_binary(&text, path));
+    fp = fopen(path, "r+b");
+    mu_assert("error, could not reopen .faccb", fp != NULL);
+    fseek(fp, (long) offsetof(FaccbHeader, cost_type), SEEK_SET);
+    fwrite(&i32, sizeof(i32), 1, fp);
+    fclose(fp);
+    init_data(&data);
+    mu_assert("error, non-integer costs declared as i32 should not load", !read_problem_data((char*) path, &data));
+    free_data(&text);
+    remove(path);
+
+    return 0;
+}
+
+// The example written as facility:cost lists (in shuffled order) must solve exactly like the dense file
+static char* test_sparse_example(void) {
+    Data data     = {0};
+    Assignment* M = NULL;
+    init_data(&data);
+    read_problem_data("example_sparse.txt", &data);
+    mu_assert("error, example_sparse.txt should load as sparse", is_sparse(&data));
+    mu_assert("error, stored costs != 35", row_begin(&data, data.n_clients) == 35);
+    double total_cost = flp(&data, &M);
+
+    mu_assert("error, cost != 38", (int) total_cost == 38);
+    mu_assert("Facility 2 - 0 assigned to 1", M[1].clients[0] == 1);
+    mu_assert("Facility 2 - 3 assigned to 7", M[1].clients[3] == 7);
+    mu_assert("Facility 4 - 2 assigned to 6", M[3].clients[2] == 6);
+    free_assignments(&data, M);
+    free_data(&data);
+
+    return 0;
+}
+
+// Clients only compete for the facilities they list; a client listing none stays unassigned
+static char* test_sparse_reachability(void) {
+    const char* text = "10 20\n"
+                       "1 100\n"
+                       "1 2 3\n"
+                       "20:1\n"
+                       "10:5 20:2\n"
+                       "\n";
+    Data data        = {0};
+    Assignment* M    = NULL;
+    init_data(&data);
+    parse_problem_text(text, strlen(text), &data);
+    mu_assert("error, unreachable facility should cost INFINITY", isinf(connection_cost(&data, 0, 0)));
+    // Client 3 lists nothing, so the instance is rejected on load; drop it and solve the rest
+    mu_assert("error, client 3 should be unreachable", unreachable_client(&data) == 2);
+    data.n_clients = 2;
+    double total_cost = flp(&data, &M);
+
+    // Both reachable clients rank facility 20 first: (100 + 1 + 2) / 2 is the only candidate at rank 0
+    mu_assert("error, cost != 103", (int) total_cost == 103);
+    mu_assert("Facility 10 serves nobody", M[0].count == 0);
+    mu_assert("Facility 20 serves clients 1 and 2", M[1].count == 2 && M[1].clients[0] == 1 && M[1].clients[1] == 2);
+    free_assignments(&data, M);
+    free_data(&data);
+
+    return 0;
+}
+
+// Integers beyond the int range are a parse error in every build, not just when asserts are enabled
+static char* test_integer_range(void) {
+    const char* valid = "1 2\n"
+                        "2147483647 -2147483648\n"
+                        "1\n"
+                        "3 4\n";
+    const char* wide  = "1 2\n"
+                        "5 6\n"
+                        "1\n"
+                        "3 21474836470\n";
+    Data data         = {0};
+    init_data(&data);
+    mu_assert("error, int limits should parse", parse_problem_text(valid, strlen(valid), &data));
+    mu_assert("error, int limits misread",
+              (int) data.opening_costs[0] == INT_MAX && (int) data.opening_costs[1] == INT_MIN);
+    free_data(&data);
+
+    init_data(&data);
+    mu_assert("error, out of range cost should not parse", !parse_problem_text(wide, strlen(wide), &data));
+    free_data(&data);
+
+    return 0;
+}
+
+// Dense text instance with costs in [1, max_cost], so rows are full of ties. Returns an stb_ds char array.
+static char* random_instance_text(uint64_t seed, size_t n_f, size_t n_c, int max_cost) {
+    char* text = NULL;
+    char number[32];
+    size_t counts[4] = {n_f, n_f, n_c, n_f};
+    for (size_t line = 0; line < 3 + n_c; line++) {
+        size_t section = line < 3 ? line : 3;
+        for (size_t i = 0; i < counts[section]; i++) {
+            seed      = seed * 6364136223846793005u + 1442695040888963407u;
+            int value = section == 0 || section == 2 ? (int) i + 1 : 1 + (int) ((seed >> 33) % (uint64_t) max_cost);
+            int len   = snprintf(number, sizeof(number), "%d ", value);
+            for (int k = 0; k < len; k++) {
+                arrpush(text, number[k]);
+            }
+        }
+        arrpush(text, '\n');
+    }
+    return text;
+}
+
+static bool same_assignments(const Assignment* a, const Assignment* b, size_t n_facilities) {
+    for (size_t i = 0; i < n_facilities; i++) {
+        if (a[i].count != b[i].count ||
+            (a[i].count > 0 && memcmp(a[i].clients, b[i].clients, a[i].count * sizeof(int)) != 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int compare_ints(const void* a, const void* b) {
+    int x = *(const int*) a;
+    int y = *(const int*) b;
+    return (x > y) - (x < y);
+}
+
+// Every client is in exactly one facility's list
+static bool assigned_once(const Assignment* M, const Data* data) {
+    int* ids = NULL;
+    for (size_t i = 0; i < data->n_facilities; i++) {
+        for (size_t k = 0; k < M[i].count; k++) {
+            arrpush(ids, M[i].clients[k]);
+        }
+    }
+    size_t n = arrlenu(ids);
+    qsort(ids, n, sizeof(int), compare_ints);
+    bool ok = n == data->n_clients;
+    for (size_t k = 1; k < n && ok; k++) {
+        ok = ids[k - 1] != ids[k];
+    }
+    arrfree(ids);
+    return ok;
+}
+
+// A candidate set kept from an earlier iteration must not hand out clients that were assigned since
+static char* test_stale_candidates(void) {
+    const char* files[2] = {"example_geo.txt", "example.txt"};
+    for (size_t f = 0; f < 2; f++) {
+        Data data = {0};
+        init_data(&data);
+        read_problem_data((char*) files[f], &data);
+        Assignment* M = NULL;
+        flp(&data, &M);
+        mu_assert("error, a client is assigned twice or not at all", assigned_once(M, &data));
+        free_assignments(&data, M);
+        free_data(&data);
+    }
+
+    char* text = random_instance_text(9, 50, 700, 40);
+    Data data  = {0};
+    init_data(&data);
+    parse_problem_text(text, arrlenu(text), &data);
+    Assignment* M = NULL;
+    flp(&data, &M);
+    mu_assert("error, a random client is assigned twice or not at all", assigned_once(M, &data));
+    free_assignments(&data, M);
+    free_data(&data);
+    arrfree(text);
+
+    return 0;
+}
+
+// Rows shorter than the number of clients (sparse lists, or dense instances with more clients than facilities) run
+// out of ranks long before every client is assigned; the solve must still connect them all
+static char* test_short_rows(void) {
+    const char* text = "1 2 3 4 5 6\n"
+                       "100 100 100 100 100 100\n"
+                       "1 2 3 4 5 6\n"
+                       "1:1\n2:1\n3:1\n4:1\n5:1\n6:1\n";
+    Data data        = {0};
+    init_data(&data);
+    parse_problem_text(text, strlen(text), &data);
+    Assignment* M     = NULL;
+    double total_cost = flp(&data, &M);
+    mu_assert("error, every client needs its own facility: cost != 606", (int) total_cost == 606);
+    mu_assert("error, a client is assigned twice or not at all", assigned_once(M, &data));
+    free_assignments(&data, M);
+    free_data(&data);
+
+    GenSpec specs[2];
+    specs[0]                   = gen_default_spec();
+    specs[0].seed              = 3;
+    specs[0].n_facilities      = 200;
+    specs[0].n_clients         = 2000;
+    specs[0].per_client        = 5;
+    specs[1]                   = gen_default_spec();
+    specs[1].n_facilities      = 50;
+    specs[1].n_clients         = 500;
+    RankStrategy strategies[2] = {RANK_LAZY, RANK_SORT};
+    for (size_t k = 0; k < 2; k++) {
+        for (size_t r = 0; r < 2; r++) {
+            init_data(&data);
+            gen_build(&specs[k], &data);
+            FlpOptions options = flp_default_options();
+            options.rank       = strategies[r];
+            M                  = NULL;
+            flp_with_options(&data, &options, &M);
+            mu_assert("error, a generated client is assigned twice or not at all", assigned_once(M, &data));
+            free_assignments(&data, M);
+            free_data(&data);
+        }
+    }
+
+    return 0;
+}
+
+// Lazy heaps and full sorts, row- or rank-major, rank ties by facility, so all must reach the same solution
+static char* test_rank_strategies_agree(void) {
+    char* text = random_instance_text(42, 40, 300, 6);
+    Data data  = {0};
+    init_data(&data);
+    parse_problem_text(text, arrlenu(text), &data);
+
+    FlpOptions options = flp_default_options();
+    options.rank       = RANK_SORT;
+    Assignment* sorted = NULL;
+    double sorted_cost = flp_with_options(&data, &options, &sorted);
+    options.rank       = RANK_LAZY;
+    Assignment* lazy   = NULL;
+    double lazy_cost   = flp_with_options(&data, &options, &lazy);
+
+    options.rank           = RANK_TRANSPOSED;
+    options.threads        = 3;
+    Assignment* transposed = NULL;
+    double transposed_cost = flp_with_options(&data, &options, &transposed);
+
+    mu_assert("error, lazy and sorted costs differ", (int) sorted_cost == (int) lazy_cost);
+    mu_assert("error, lazy and sorted assignments differ", same_assignments(sorted, lazy, data.n_facilities));
+    mu_assert("error, transposed cost differs", memcmp(&transposed_cost, &sorted_cost, sizeof(double)) == 0);
+    mu_assert("error, transposed assignments differ", same_assignments(transposed, sorted, data.n_facilities));
+    free_assignments(&data, sorted);
+    free_assignments(&data, lazy);
+    free_assignments(&data, transposed);
+    free_data(&data);
+    arrfree(text);
+
+    return 0;
+}
+
+// Sorting networks (short rows) and radix sorts (long rows) must order by cost, then facility, across signs and
+// zeros of either sign, with either width of facility positions
+static char* test_sort_rows(void) {
+    const float values[6]  = {-0.0f, 0.0f, -1.5f, 3.25f, -1e30f, 1e-30f};
+    float* floats          = malloc(2000 * sizeof(float));
+    uint32_t* float_places = malloc(2000 * sizeof(uint32_t));
+    int32_t* ints          = malloc(2000 * sizeof(int32_t));
+    uint16_t* int_places   = malloc(2000 * sizeof(uint16_t));
+    RankRowF32_U32 row     = {.cost = floats, .facility = float_places};
+    RankRowI32_U16 int_row = {.cost = ints, .facility = int_places};
+    uint64_t seed          = 3;
+    const size_t lens[5]   = {2, 7, 16, 17, 1000};
+    for (size_t l = 0; l < 5; l++) {
+        size_t len = lens[l];
+        for (size_t k = 0; k < len; k++) {
+            seed            = seed * 6364136223846793005u + 1442695040888963407u;
+            floats[k]       = values[(seed >> 33) % 6];
+            ints[k]         = k % 3 == 0 ? INT32_MIN : (int32_t) (seed >> 32);
+            float_places[k] = (uint32_t) k;
+            int_places[k]   = (uint16_t) k;
+        }
+        if (len <= RANK_NETWORK_MAX) {
+            sort_network_F32_U32(row, len);
+            sort_network_I32_U16(int_row, len);
+        } else {
+            RankRowF32_U32 scratch     = {.cost = floats + len, .facility = float_places + len};
+            RankRowI32_U16 int_scratch = {.cost = ints + len, .facility = int_places + len};
+            radix_sort_F32_U32(row, scratch, len);
+            radix_sort_I32_U16(int_row, int_scratch, len);
+        }
+        for (size_t k = 1; k < len; k++) {
+            mu_assert("error, float row out of order", entry_before_F32_U32(row, k - 1, k));
+            mu_assert("error, int32 row out of order", entry_before_I32_U16(int_row, k - 1, k));
+        }
+    }
+    free(floats);
+    free(float_places);
+    free(ints);
+    free(int_places);
+
+    return 0;
+}
+
+// Integer costs can be ranked as int32, float or double; each must give the same solution, bit for bit
+static char* test_cost_types_agree(void) {
+    char* text = random_instance_text(11, 35, 500, 7);
+    Data data  = {0};
+    init_data(&data);
+    parse_problem_text(text, arrlenu(text), &data);
+    mu_assert("error, text costs should rank as int32", data.cost_type == COST_I32);
+
+    const CostType types[3]     = {COST_F64, COST_F32, COST_I32};
+    const RankStrategy ranks[3] = {RANK_LAZY, RANK_SORT, RANK_TRANSPOSED};
+    for (size_t r = 0; r < 3; r++) {
+        FlpOptions options   = flp_default_options();
+        options.rank         = ranks[r];
+        Assignment* expected = NULL;
+        double expected_cost = flp_with_options(&data, &options, &expected);
+        for (size_t c = 0; c < 3; c++) {
+            options.cost_type = types[c];
+            Assignment* got   = NULL;
+            double got_cost   = flp_with_options(&data, &options, &got);
+            mu_assert("error, cost type changes the cost", memcmp(&got_cost, &expected_cost, sizeof(double)) == 0);
+            mu_assert("error, cost type changes the assignments", same_assignments(got, expected, data.n_facilities));
+            free_assignments(&data, got);
+        }
+        free_assignments(&data, expected);
+    }
+
+    FlpOptions options   = flp_default_options();
+    options.exact_ratios = false;
+    Assignment* rounded  = NULL;
+    Assignment* exact    = NULL;
+    double rounded_cost  = flp_with_options(&data, &options, &rounded);
+    options.exact_ratios = true;
+    double exact_cost    = flp_with_options(&data, &options, &exact);
+    mu_assert("error, exact ratios change the cost", memcmp(&exact_cost, &rounded_cost, sizeof(double)) == 0);
+    mu_assert("error, exact ratios change the assignments", same_assignments(exact, rounded, data.n_facilities));
+    free_assignments(&data, rounded);
+    free_assignments(&data, exact);
+#ifdef FACC_EXACT_RATIOS
+    // Sums past 2^53 round to the same double; the cross-multiplied comparison still tells them apart
+    int64_t big = (int64_t) 1 << 53;
+    mu_assert("error, rounded ratios should tie", double_ratio_order((double) (big + 1) / 3, (double) big / 3) == 0);
+    mu_assert("error, exact ratios should not tie", exact_ratio_order(big + 1, 3, big, 3) > 0);
+    mu_assert("error, 5/3 is below 7/4", exact_ratio_order(5, 3, 7, 4) < 0 && exact_ratio_order(-2, 1, -6, 3) == 0);
+#endif
+
+    data.connection_costs[3] = 2.5;
+    data.cost_type           = COST_F64; // as a loader would record it
+    mu_assert("error, 2.5 is no int32", !cost_type_fits(&data, COST_I32) && narrowest_cost_type(&data) == COST_F32);
+    data.connection_costs[3] = 0.1;
+    mu_assert("error, 0.1 is no float", narrowest_cost_type(&data) == COST_F64);
+    free_data(&data);
+    arrfree(text);
+
+    return 0;
+}
+
+// Building rows on several threads must not change the ranking or the solution
+static char* test_threads_match_serial(void) {
+    char* text = random_instance_text(7, 30, 2000, 5);
+    Data data  = {0};
+    init_data(&data);
+    parse_problem_text(text, arrlenu(text), &data);
+
+    RankMatrix serial, parallel;
+    ThreadPool* pool = pool_create(4);
+    rank_matrix_build(&serial, &data, RANK_SORT, COST_AUTO, NULL, NULL);
+    rank_matrix_build(&parallel, &data, RANK_SORT, COST_AUTO, pool, NULL);
+    size_t n_pairs = data.n_clients * data.n_facilities;
+    mu_assert("error, parallel rank costs differ",
+              memcmp(serial.costs, parallel.costs, n_pairs * rank_cost_size(serial.cost_type)) == 0);
+    mu_assert("error, parallel rank facilities differ",
+              memcmp(serial.facilities, parallel.facilities, n_pairs * serial.index_size) == 0);
+    mu_assert("error, n_ranks differs", serial.n_ranks == parallel.n_ranks);
+    rank_matrix_free(&serial);
+    rank_matrix_free(&parallel);
+    pool_destroy(pool);
+
+    FlpOptions options = flp_default_options();
+    Assignment* one    = NULL;
+    double one_cost    = flp_with_options(&data, &options, &one);
+    options.threads    = 4;
+    Assignment* four   = NULL;
+    double four_cost   = flp_with_options(&data, &options, &four);
+    mu_assert("error, threaded cost differs", (int) one_cost == (int) four_cost);
+    mu_assert("error, threaded assignments differ", same_assignments(one, four, data.n_facilities));
+    free_assignments(&data, one);
+    free_assignments(&data, four);
+    free_data(&data);
+    arrfree(text);
+
+    return 0;
+}
+
+// Work stealing splits and moves ranges around, but every item must still run exactly once
+static void count_items(void* ctx, size_t begin, size_t end, size_t worker) {
+    unsigned* visits = ctx;
+    (void) worker;
+    for (size_t i = begin; i < end; i++) {
+        // The first items are far heavier, so their owner falls behind and gets robbed
+        for (volatile size_t spin = 0; spin < (i < 8 ? 200000u : 10u); spin++) {
+        }
+        visits[i]++;
+    }
+}
+
+static char* test_pool_for_covers_range(void) {
+    ThreadPool* pool = pool_create(4);
+    for (size_t n = 0; n < 300; n += 37) {
+        unsigned* visits = calloc(n + 1, sizeof(unsigned));
+        pool_for(pool, n, 3, count_items, visits);
+        for (size_t i = 0; i < n; i++) {
+            mu_assert("error, item not visited exactly once", visits[i] == 1);
+        }
+        free(visits);
+    }
+    pool_destroy(pool);
+
+    return 0;
+}
+
+// Arena allocations are aligned, keep their contents until the reset, and reuse one coalesced block afterwards
+static char* test_arena_alloc(void) {
+    Arena arena;
+    arena_init(&arena);
+
+    for (int round = 0; round < 3; round++) {
+        arena_reset(&arena);
+        int* a[64];
+        for (int k = 0; k < 64; k++) {
+            a[k] = arena_alloc(&arena, 4000 * sizeof(int) + (size_t) k);
+            mu_assert("error, arena allocation misaligned", (uintptr_t) a[k] % 16 == 0);
+            for (int i = 0; i < 4000; i++) {
+                a[k][i] = k * i;
+            }
+        }
+        for (int k = 0; k < 64; k++) {
+            mu_assert("error, arena allocation lost contents", a[k][0] == 0 && a[k][3999] == k * 3999);
+        }
+    }
+
+    arena_reset(&arena);
+    mu_assert("error, reset should leave a single block", arena.blocks && !arena.blocks->next);
+    arena_free(&arena);
+
+    return 0;
+}
+
+// Bits past n stay clear so whole-word scans never visit a position that does not exist
+static char* test_bitset(void) {
+    uint64_t* bits = bitset_alloc(130, true);
+    mu_assert("error, count != 130", bitset_count(bits, 130) == 130);
+    mu_assert("error, tail bits set", bits[2] == 3);
+    bitset_clear(bits, 64);
+    bitset_clear(bits, 129);
+    mu_assert("error, cleared bit still set", !bitset_get(bits, 64) && !bitset_get(bits, 129));
+    mu_assert("error, lowest set bit of word 1", bitset_lowest(1, bits[1]) == 65);
+    mu_assert("error, count != 128", bitset_count(bits, 130) == 128);
+    free(bits);
+
+    return 0;
+}
+
+static char* test_simd_kernels_agree(void) {
+    const SimdKernels* scalar = simd_kernels(SIMD_SCALAR);
+    double ratio[67];
+    size_t count[67];
+    uint64_t state = 7;
+    for (SimdLevel level = SIMD_AVX2; level <= SIMD_AVX512; level++) {
+        const SimdKernels* kernels = simd_kernels(level);
+        if (!kernels) {
+            continue; // not on this CPU
+        }
+        for (size_t n = 0; n <= 67; n++) {
+            for (int round = 0; round < 20; round++) {
+                // Few distinct values so ties on both ratio and count are common, plus the odd inf and NaN
+                for (size_t i = 0; i < n; i++) {
+                    state    = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                    ratio[i] = (double) (state >> 60) / 3.0;
+                    count[i] = (size_t) (state >> 33) % 4;
+                    if ((state >> 20) % 16 == 0) {
+                        ratio[i] = (state >> 24) % 2 ? INFINITY : NAN;
+                    }
+                }
+                double a = scalar->sum(ratio, n);
+                double b = kernels->sum(ratio, n);
+                mu_assert("error, vector sum differs from scalar", memcmp(&a, &b, sizeof(double)) == 0);
+                mu_assert("error, vector argmin differs from scalar",
+                          scalar->argmin(ratio, count, n) == kernels->argmin(ratio, count, n));
+            }
+        }
+    }
+
+    return 0;
+}
+
+// facc-gen's text output must parse back into exactly the instance it builds in memory
+static char* test_generator_text_matches_build(void) {
+    GenSpec specs[2];
+    specs[0]              = gen_default_spec();
+    specs[0].seed         = 99;
+    specs[0].n_facilities = 30;
+    specs[0].n_clients    = 50;
+    specs[0].costs        = GEN_COSTS_EUCLIDEAN;
+    specs[1]              = specs[0];
+    specs[1].costs        = GEN_COSTS_CLUSTERED;
+    specs[1].opening      = GEN_OPENING_HEAVY_TAILED;
+    specs[1].per_client   = 7;
+
+    for (size_t s = 0; s < 2; s++) {
+        char* text  = NULL;
+        size_t size = 0;
+        FILE* f     = open_memstream(&text, &size);
+        mu_assert("error, could not write generated text", gen_write_text(&specs[s], f));
+        fclose(f);
+
+        Data parsed = {0}, built = {0};
+        init_data(&parsed);
+        parse_problem_text(text, size, &parsed);
+        gen_build(&specs[s], &built);
+        size_t n_costs = row_begin(&built, built.n_clients);
+        mu_assert("error, generated sizes differ",
+                  parsed.n_facilities == built.n_facilities && parsed.n_clients == built.n_clients);
+        mu_assert("error, generated sparsity differs", is_sparse(&parsed) == (specs[s].per_client > 0));
+        mu_assert("error, generated layouts differ", row_begin(&parsed, parsed.n_clients) == n_costs);
+        mu_assert("error, generated opening costs differ",
+                  memcmp(parsed.opening_costs, built.opening_costs, built.n_facilities * sizeof(double)) == 0);
+        mu_assert("error, generated connection costs differ",
+                  memcmp(parsed.connection_costs, built.connection_costs, n_costs * sizeof(double)) == 0);
+        mu_assert("error, generated sparse rows differ",
+                  !is_sparse(&built) || memcmp(parsed.cost_facilities, built.cost_facilities,
+                                               n_costs * sizeof(uint32_t)) == 0);
+        free_data(&parsed);
+        free_data(&built);
+        free(text);
+    }
+
+    return 0;
+}
+
+// Point instances rank through the k-d tree, in batches. Solving the same instance with every cost materialised
+// as a dense matrix must give the same solution, ties (points on a grid) included.
+static char* test_geo_matches_dense(void) {
+    const char* headers[2] = {"geo euclidean 1.5", "geo haversine 0.25"};
+    const size_t n_f = 60, n_c = 400;
+    uint64_t seed    = 5;
+
+    for (size_t m = 0; m < 2; m++) {
+        char* text  = NULL;
+        size_t size = 0;
+        FILE* f     = open_memstream(&text, &size);
+        fprintf(f, "%s\n", headers[m]);
+        for (size_t line = 0; line < 3; line++) {
+            for (size_t i = 0; i < (line == 2 ? n_c : n_f); i++) {
+                seed = seed * 6364136223846793005u + 1442695040888963407u;
+                fprintf(f, "%d ", line == 1 ? 1 + (int) ((seed >> 33) % 40) : (int) i + 1);
+            }
+            fprintf(f, "\n");
+        }
+        for (size_t i = 0; i < n_f + n_c; i++) {
+            seed       = seed * 6364136223846793005u + 1442695040888963407u;
+            unsigned x = (unsigned) (seed >> 40) % 12, y = (unsigned) (seed >> 20) % 12;
+            fprintf(f, m == 0 ? "%u %u\n" : "%u.5 -%u.25\n", x, y);
+        }
+        fclose(f);
+
+        Data geo = {0}, dense = {0};
+        init_data(&geo);
+        init_data(&dense);
+        parse_problem_text(text, size, &geo);
+        mu_assert("error, point instance not recognised", is_geo(&geo) && geo.n_clients == n_c);
+        for (size_t i = 0; i < n_f; i++) {
+            arrpush(dense.facilities, geo.facilities[i]);
+            arrpush(dense.opening_costs, geo.opening_costs[i]);
+        }
+        for (size_t c = 0; c < n_c; c++) {
+            arrpush(dense.clients, geo.clients[c]);
+        }
+        dense.n_facilities     = n_f;
+        dense.n_clients        = n_c;
+        dense.connection_costs = alloc_matrix(n_c, n_f, sizeof(double));
+        for (size_t c = 0; c < n_c; c++) {
+            for (size_t i = 0; i < n_f; i++) {
+                dense.connection_costs[c * n_f + i] = connection_cost(&geo, c, i);
+            }
+        }
+
+        FlpOptions options   = flp_default_options();
+        Assignment* expected = NULL;
+        double expected_cost = flp_with_options(&dense, &options, &expected);
+        for (size_t threads = 1; threads <= 4; threads += 3) {
+            options.threads = threads;
+            Assignment* got = NULL;
+            double got_cost = flp_with_options(&geo, &options, &got);
+            mu_assert("error, point instance cost differs", memcmp(&got_cost, &expected_cost, sizeof(double)) == 0);
+            mu_assert("error, point instance assignments differ", same_assignments(got, expected, n_f));
+            free_assignments(&geo, got);
+        }
+        free_assignments(&dense, expected);
+        free_data(&geo);
+        free_data(&dense);
+        free(text);
+    }
+
+    return 0;
+}
+
 static char* all_tests(void) {
     mu_run_test(test_example);
+    mu_run_test(test_long_rows);
+    mu_run_test(test_binary_roundtrip);
+    mu_run_test(test_sparse_example);
+    mu_run_test(test_sparse_reachability);
+    mu_run_test(test_integer_range);
+    mu_run_test(test_stale_candidates);
+    mu_run_test(test_short_rows);
+    mu_run_test(test_rank_strategies_agree);
+    mu_run_test(test_sort_rows);
+    mu_run_test(test_cost_types_agree);
+    mu_run_test(test_threads_match_serial);
+    mu_run_test(test_pool_for_covers_range);
+    mu_run_test(test_arena_alloc);
+    mu_run_test(test_bitset);
+    mu_run_test(test_simd_kernels_agree);
+    mu_run_test(test_generator_text_matches_build);
+    mu_run_test(test_geo_matches_dense);
     return 0;
 }
 
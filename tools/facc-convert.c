@@ -0,0 +1,24 @@
+#include <stdio.h>
+#include "facc.h"
+
+// Convert an instance in the 4-section text format into the binary .faccb format that facc loads with mmap
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        printf("Usage: %s <input_file> <output.faccb>\n", argv[0]);
+        return 1;
+    }
+
+    Data data = {0};
+    init_data(&data);
+    if (!read_problem_data(argv[1], &data)) {
+        return 1;
+    }
+
+    bool ok = write_problem_binary(&data, argv[2]);
+    if (ok) {
+        printf("wrote %zu facilities x %zu clients to %s\n", data.n_facilities, data.n_clients, argv[2]);
+    }
+    free_data(&data);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "facc.h"
+#include "gen.h"
+
+// Write a reproducible random instance, in the text format or as .faccb
+
+static void print_usage(const char* program) {
+    printf("Usage: %s [options] <output_file>\n", program);
+    printf("Options:\n");
+    printf("  --facilities N                       number of facilities (default 1000)\n");
+    printf("  --clients N                          number of clients (default 1000)\n");
+    printf("  --seed S                             random seed (default 1)\n");
+    printf("  --costs uniform|euclidean|clustered  connection cost layout (default uniform)\n");
+    printf("  --opening uniform|heavy-tailed       opening cost distribution (default uniform)\n");
+    printf("  --per-client K                       sparse lists of K random facilities per client (default dense)\n");
+    printf("  --binary                             write .faccb (also chosen by a .faccb extension)\n");
+    printf("An output file of - writes text to stdout.\n");
+}
+
+static bool parse_size(const char* text, size_t* value) {
+    char* end;
+    unsigned long long n = strtoull(text, &end, 10);
+    if (*end != '\0' || text[0] == '-' || text[0] == '\0') {
+        printf("Invalid number '%s'\n", text);
+        return false;
+    }
+    *value = (size_t) n;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    GenSpec spec   = gen_default_spec();
+    bool binary    = false;
+    char* filename = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        size_t seed;
+        if (strcmp(argv[i], "--facilities") == 0 && i + 1 < argc) {
+            if (!parse_size(argv[++i], &spec.n_facilities)) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+            if (!parse_size(argv[++i], &spec.n_clients)) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            if (!parse_size(argv[++i], &seed)) {
+                return 1;
+            }
+            spec.seed = seed;
+        } else if (strcmp(argv[i], "--per-client") == 0 && i + 1 < argc) {
+            if (!parse_size(argv[++i], &spec.per_client)) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--costs") == 0 && i + 1 < argc) {
+            const char* layout = argv[++i];
+            if (strcmp(layout, "uniform") == 0) {
+                spec.costs = GEN_COSTS_UNIFORM;
+            } else if (strcmp(layout, "euclidean") == 0) {
+                spec.costs = GEN_COSTS_EUCLIDEAN;
+            } else if (strcmp(layout, "clustered") == 0) {
+                spec.costs = GEN_COSTS_CLUSTERED;
+            } else {
+                printf("Unknown cost layout '%s'\n", layout);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--opening") == 0 && i + 1 < argc) {
+            const char* distribution = argv[++i];
+            if (strcmp(distribution, "uniform") == 0) {
+                spec.opening = GEN_OPENING_UNIFORM;
+            } else if (strcmp(distribution, "heavy-tailed") == 0) {
+                spec.opening = GEN_OPENING_HEAVY_TAILED;
+            } else {
+                printf("Unknown opening cost distribution '%s'\n", distribution);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--binary") == 0) {
+            binary = true;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if ((argv[i][0] == '-' && argv[i][1] != '\0') || filename) {
+            printf("Unexpected argument '%s'\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if (!filename) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    size_t len = strlen(filename);
+    binary     = binary || (len > 6 && strcmp(filename + len - 6, ".faccb") == 0);
+
+    if (binary) {
+        if (strcmp(filename, "-") == 0) {
+            printf("Binary output needs a file\n");
+            return 1;
+        }
+        // .faccb is written from memory, so the whole instance is built first
+        Data data;
+        gen_build(&spec, &data);
+        bool ok = write_problem_binary(&data, filename);
+        free_data(&data);
+        return ok ? 0 : 1;
+    }
+
+    FILE* f = strcmp(filename, "-") == 0 ? stdout : fopen(filename, "w");
+    if (!f) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return 1;
+    }
+    bool ok = gen_write_text(&spec, f);
+    ok      = (f == stdout ? fflush(f) == 0 : fclose(f) == 0) && ok;
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write %s\n", filename);
+    }
+    return ok ? 0 : 1;
+}